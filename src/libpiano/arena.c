@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "arena.h"
+
+/* allocations are served from blocks of this size; larger requests get their
+ * own block */
+#define PIANO_ARENA_BLOCK_SIZE (16*1024)
+
+typedef struct PianoArenaBlock {
+	struct PianoArenaBlock *next;
+	size_t used, size;
+	/* block data follows */
+	char data[];
+} PianoArenaBlock_t;
+
+struct PianoArena {
+	/* newest block first, only this one is bump-allocated from */
+	PianoArenaBlock_t *blocks;
+	size_t refcount;
+};
+
+/*	create arena with one reference (the creator's)
+ */
+PianoArena_t *PianoArenaCreate (void) {
+	PianoArena_t *arena;
+
+	if ((arena = malloc (sizeof (*arena))) == NULL) {
+		return NULL;
+	}
+	arena->blocks = NULL;
+	arena->refcount = 1;
+
+	return arena;
+}
+
+/*	bump-allocate zeroed memory from the arena; it is freed together with
+ *	the arena, there is no per-object free
+ */
+void *PianoArenaCalloc (PianoArena_t *arena, size_t size) {
+	PianoArenaBlock_t *block;
+
+	assert (arena != NULL);
+
+	/* keep allocations aligned */
+	size = (size + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
+
+	block = arena->blocks;
+	if (block == NULL || block->size - block->used < size) {
+		const size_t blockSize = size > PIANO_ARENA_BLOCK_SIZE ?
+				size : PIANO_ARENA_BLOCK_SIZE;
+		/* calloc, so allocations handed out are zeroed already */
+		if ((block = calloc (1, sizeof (*block) + blockSize)) == NULL) {
+			return NULL;
+		}
+		block->size = blockSize;
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+
+	void * const ret = &block->data[block->used];
+	block->used += size;
+
+	return ret;
+}
+
+/*	strdup into the arena
+ */
+char *PianoArenaStrdup (PianoArena_t *arena, const char *s) {
+	assert (arena != NULL);
+
+	if (s == NULL) {
+		return NULL;
+	}
+
+	const size_t len = strlen (s) + 1;
+	char * const ret = PianoArenaCalloc (arena, len);
+	if (ret != NULL) {
+		memcpy (ret, s, len);
+	}
+
+	return ret;
+}
+
+void PianoArenaRef (PianoArena_t *arena) {
+	assert (arena != NULL);
+
+	++arena->refcount;
+}
+
+/*	drop one reference; the last one frees all blocks at once
+ */
+void PianoArenaUnref (PianoArena_t *arena) {
+	assert (arena != NULL);
+	assert (arena->refcount > 0);
+
+	if (--arena->refcount > 0) {
+		return;
+	}
+
+	PianoArenaBlock_t *block = arena->blocks;
+	while (block != NULL) {
+		PianoArenaBlock_t * const next = block->next;
+		free (block);
+		block = next;
+	}
+	free (arena);
+}
@@ -0,0 +1,40 @@
+/*
+Copyright (c) 2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_LIBPIANO_ARENA_H_QW7QGD4M
+#define SRC_LIBPIANO_ARENA_H_QW7QGD4M
+
+#include <stdlib.h>
+
+/* reference-counted bump allocator; objects parsed from one response share
+ * one arena and every object holds a reference, so the whole response is
+ * freed with the last object instead of one free() per string */
+typedef struct PianoArena PianoArena_t;
+
+PianoArena_t *PianoArenaCreate (void);
+void *PianoArenaCalloc (PianoArena_t *, size_t);
+char *PianoArenaStrdup (PianoArena_t *, const char *);
+void PianoArenaRef (PianoArena_t *);
+void PianoArenaUnref (PianoArena_t *);
+
+#endif /* SRC_LIBPIANO_ARENA_H_QW7QGD4M */
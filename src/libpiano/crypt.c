@@ -29,6 +29,21 @@ THE SOFTWARE.
 
 #include "crypt.h"
 
+static const char hexDigits[] = "0123456789abcdef";
+
+/*	value of a single hex digit, -1 if invalid
+ */
+static int PianoHexValue (const char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
 /*	decrypt hex-encoded, blowfish-crypted string: decode 2 hex-encoded blocks,
  *	decrypt, byteswap
  *	@param gcrypt handle
@@ -48,10 +63,13 @@ char *PianoDecryptString (gcry_cipher_hd_t h, const char * const input,
 	output = calloc (outputLen+1, sizeof (*output));
 	/* hex decode */
 	for (size_t i = 0; i < outputLen; i++) {
-		char hex[3];
-		memcpy (hex, &input[i*2], 2);
-		hex[2] = '\0';
-		output[i] = strtol (hex, NULL, 16);
+		const int hi = PianoHexValue (input[i*2]),
+				lo = PianoHexValue (input[i*2+1]);
+		if (hi < 0 || lo < 0) {
+			free (output);
+			return NULL;
+		}
+		output[i] = hi << 4 | lo;
 	}
 
 	gret = gcry_cipher_decrypt (h, output, outputLen, NULL, 0);
@@ -88,7 +106,8 @@ char *PianoEncryptString (gcry_cipher_hd_t h, const char *s) {
 
 	hexOutput = calloc (paddedInputLen*2+1, sizeof (*hexOutput));
 	for (size_t i = 0; i < paddedInputLen; i++) {
-		snprintf ((char * restrict) &hexOutput[i*2], 3, "%02x", paddedInput[i]);
+		hexOutput[i*2] = hexDigits[paddedInput[i] >> 4];
+		hexOutput[i*2+1] = hexDigits[paddedInput[i] & 0x0f];
 	}
 
 	free (paddedInput);
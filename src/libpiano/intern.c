@@ -0,0 +1,150 @@
+/*
+Copyright (c) 2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* reference-counted string interning pool, see intern.h */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "intern.h"
+
+#define PIANO_INTERN_BUCKETS 256
+
+typedef struct PianoInternEntry {
+	struct PianoInternEntry *next;
+	unsigned int refcount;
+	unsigned int hash;
+	char str[];
+} PianoInternEntry_t;
+
+struct PianoIntern {
+	pthread_mutex_t lock;
+	PianoInternEntry_t *buckets[PIANO_INTERN_BUCKETS];
+};
+
+/*	fnv-1a
+ */
+static unsigned int PianoInternHash (const char *s) {
+	unsigned int hash = 2166136261u;
+
+	for (; *s != '\0'; s++) {
+		hash ^= (unsigned char) *s;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+PianoIntern_t *PianoInternCreate (void) {
+	PianoIntern_t *pool = calloc (1, sizeof (*pool));
+
+	if (pool == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init (&pool->lock, NULL);
+	return pool;
+}
+
+/*	free the pool; all references must have been dropped before
+ */
+void PianoInternDestroy (PianoIntern_t *pool) {
+	if (pool == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < PIANO_INTERN_BUCKETS; i++) {
+		PianoInternEntry_t *entry = pool->buckets[i];
+		while (entry != NULL) {
+			PianoInternEntry_t * const next = entry->next;
+			free (entry);
+			entry = next;
+		}
+	}
+	pthread_mutex_destroy (&pool->lock);
+	free (pool);
+}
+
+/*	return a shared copy of s holding one reference, or NULL for NULL/oom
+ */
+char *PianoInternGet (PianoIntern_t *pool, const char *s) {
+	if (s == NULL) {
+		return NULL;
+	}
+
+	const unsigned int hash = PianoInternHash (s);
+	PianoInternEntry_t **bucket =
+			&pool->buckets[hash % PIANO_INTERN_BUCKETS];
+
+	pthread_mutex_lock (&pool->lock);
+	for (PianoInternEntry_t *entry = *bucket; entry != NULL;
+			entry = entry->next) {
+		if (entry->hash == hash && strcmp (entry->str, s) == 0) {
+			++entry->refcount;
+			pthread_mutex_unlock (&pool->lock);
+			return entry->str;
+		}
+	}
+
+	PianoInternEntry_t * const entry = malloc (sizeof (*entry) +
+			strlen (s) + 1);
+	if (entry == NULL) {
+		pthread_mutex_unlock (&pool->lock);
+		return NULL;
+	}
+	entry->refcount = 1;
+	entry->hash = hash;
+	strcpy (entry->str, s);
+	entry->next = *bucket;
+	*bucket = entry;
+	pthread_mutex_unlock (&pool->lock);
+
+	return entry->str;
+}
+
+/*	drop one reference, the last one frees the entry; s must have been
+ *	returned by PianoInternGet (NULL is ignored)
+ */
+void PianoInternRelease (PianoIntern_t *pool, char *s) {
+	if (s == NULL) {
+		return;
+	}
+
+	PianoInternEntry_t * const entry = (PianoInternEntry_t *)
+			(s - offsetof (PianoInternEntry_t, str));
+	PianoInternEntry_t **bucket =
+			&pool->buckets[entry->hash % PIANO_INTERN_BUCKETS];
+
+	pthread_mutex_lock (&pool->lock);
+	assert (entry->refcount > 0);
+	if (--entry->refcount == 0) {
+		/* unlink */
+		while (*bucket != entry) {
+			assert (*bucket != NULL);
+			bucket = &(*bucket)->next;
+		}
+		*bucket = entry->next;
+		free (entry);
+	}
+	pthread_mutex_unlock (&pool->lock);
+}
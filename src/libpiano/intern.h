@@ -0,0 +1,38 @@
+/*
+Copyright (c) 2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_LIBPIANO_INTERN_H_X3K9PFQ2
+#define SRC_LIBPIANO_INTERN_H_X3K9PFQ2
+
+/* reference-counted string interning pool: identical strings (artist and
+ * station names recur across playlists and the history) are stored once
+ * and shared by pointer. the pool has its own lock, references can be
+ * taken and dropped from any thread */
+typedef struct PianoIntern PianoIntern_t;
+
+PianoIntern_t *PianoInternCreate (void);
+void PianoInternDestroy (PianoIntern_t *);
+char *PianoInternGet (PianoIntern_t *, const char *);
+void PianoInternRelease (PianoIntern_t *, char *);
+
+#endif /* SRC_LIBPIANO_INTERN_H_X3K9PFQ2 */
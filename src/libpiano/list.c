@@ -95,6 +95,38 @@ void *PianoListGet (PianoListHead_t * const l, const size_t n) {
 	return NULL;
 }
 
+/*	initialize list container from an existing list head (may be NULL); the
+ *	list is walked once here, subsequent pushes are O(1)
+ */
+void PianoListInit (PianoList_t * const list, PianoListHead_t * const l) {
+	assert (list != NULL);
+
+	list->head = l;
+	list->tail = NULL;
+	list->count = 0;
+
+	for (PianoListHead_t *curr = l; curr != NULL; curr = curr->next) {
+		list->tail = curr;
+		++list->count;
+	}
+}
+
+/*	append element e to list container in constant time
+ */
+void PianoListPush (PianoList_t * const list, PianoListHead_t * const e) {
+	assert (list != NULL);
+	assert (e != NULL);
+	assert (e->next == NULL);
+
+	if (list->tail == NULL) {
+		list->head = e;
+	} else {
+		list->tail->next = e;
+	}
+	list->tail = e;
+	++list->count;
+}
+
 /*	count elements in list l
  */
 size_t PianoListCount (const PianoListHead_t * const l) {
@@ -31,9 +31,12 @@ THE SOFTWARE.
 #include <stdlib.h>
 #include <assert.h>
 #include <stdint.h>
+#include <json.h>
 
 #include "piano_private.h"
 #include "piano.h"
+#include "arena.h"
+#include "intern.h"
 #include "config.h"
 
 /*	initialize piano handle
@@ -47,6 +50,9 @@ PianoReturn_t PianoInit (PianoHandle_t *ph, const char *partnerUser,
 	ph->partner.user = strdup (partnerUser);
 	ph->partner.password = strdup (partnerPassword);
 	ph->partner.device = strdup (device);
+	if ((ph->intern = PianoInternCreate ()) == NULL) {
+		return PIANO_RET_OUT_OF_MEMORY;
+	}
 
 	if (gcry_cipher_open (&ph->partner.in, GCRY_CIPHER_BLOWFISH,
 			GCRY_CIPHER_MODE_ECB, 0) != GPG_ERR_NO_ERROR) {
@@ -98,24 +104,38 @@ void PianoDestroySearchResult (PianoSearchResult_t *searchResult) {
  *	@param station
  */
 void PianoDestroyStation (PianoStation_t *station) {
-	free (station->name);
-	free (station->id);
-	free (station->seedId);
-	memset (station, 0, sizeof (*station));
+	PianoArena_t * const arena = station->arena;
+
+	/* clear before unref: the station itself lives in the arena, so
+	 * dropping the last reference frees its memory */
+	if (arena != NULL) {
+		memset (station, 0, sizeof (*station));
+		/* station and its strings live in the arena; dropping the station's
+		 * reference frees everything once the last sibling is gone */
+		PianoArenaUnref (arena);
+	} else {
+		free (station->name);
+		free (station->id);
+		free (station->seedId);
+		memset (station, 0, sizeof (*station));
+	}
 }
 
 /*	free complete station list
  *	@param piano handle
  */
-static void PianoDestroyStations (PianoStation_t *stations) {
+void PianoDestroyStations (PianoStation_t *stations) {
 	PianoStation_t *curStation, *lastStation;
 
 	curStation = stations;
 	while (curStation != NULL) {
 		lastStation = curStation;
 		curStation = (PianoStation_t *) curStation->head.next;
+		const bool fromArena = lastStation->arena != NULL;
 		PianoDestroyStation (lastStation);
-		free (lastStation);
+		if (!fromArena) {
+			free (lastStation);
+		}
 	}
 }
 
@@ -129,20 +149,37 @@ void PianoDestroyPlaylist (PianoSong_t *playlist) {
 
 	curSong = playlist;
 	while (curSong != NULL) {
-		free (curSong->audioUrl);
-		free (curSong->coverArt);
-		free (curSong->artist);
-		free (curSong->musicId);
-		free (curSong->title);
-		free (curSong->stationId);
-		free (curSong->album);
-		free (curSong->feedbackId);
-		free (curSong->seedId);
-		free (curSong->detailUrl);
-		free (curSong->trackToken);
 		lastSong = curSong;
 		curSong = (PianoSong_t *) curSong->head.next;
-		free (lastSong);
+		if (lastSong->intern != NULL) {
+			/* these fields are shared through the interning pool, see
+			 * response.c */
+			PianoInternRelease (lastSong->intern, lastSong->artist);
+			PianoInternRelease (lastSong->intern, lastSong->album);
+			PianoInternRelease (lastSong->intern, lastSong->stationId);
+			PianoInternRelease (lastSong->intern, lastSong->detailUrl);
+			lastSong->artist = NULL;
+			lastSong->album = NULL;
+			lastSong->stationId = NULL;
+			lastSong->detailUrl = NULL;
+		}
+		if (lastSong->arena != NULL) {
+			/* song and strings live in the arena, just drop the reference */
+			PianoArenaUnref (lastSong->arena);
+		} else {
+			free (lastSong->audioUrl);
+			free (lastSong->coverArt);
+			free (lastSong->artist);
+			free (lastSong->musicId);
+			free (lastSong->title);
+			free (lastSong->stationId);
+			free (lastSong->album);
+			free (lastSong->feedbackId);
+			free (lastSong->seedId);
+			free (lastSong->detailUrl);
+			free (lastSong->trackToken);
+			free (lastSong);
+		}
 	}
 }
 
@@ -195,6 +232,9 @@ void PianoDestroy (PianoHandle_t *ph) {
 	PianoDestroyUserInfo (&ph->user);
 	PianoDestroyStations (ph->stations);
 	PianoDestroyPartner (&ph->partner);
+	/* all playlists must have been destroyed at this point, they hold
+	 * references into the pool */
+	PianoInternDestroy (ph->intern);
 	/* destroy genre stations */
 	PianoGenreCategory_t *curGenreCat = ph->genreStations, *lastGenreCat;
 	while (curGenreCat != NULL) {
@@ -212,6 +252,12 @@ void PianoDestroy (PianoHandle_t *ph) {
  *	@param piano request
  */
 void PianoDestroyRequest (PianoRequest_t *req) {
+	if (req->responseTokener != NULL) {
+		json_tokener_free (req->responseTokener);
+	}
+	if (req->responseObj != NULL) {
+		json_object_put (req->responseObj);
+	}
 	free (req->postData);
 	memset (req, 0, sizeof (*req));
 }
@@ -59,6 +59,9 @@ typedef struct PianoStation {
 	char *name;
 	char *id;
 	char *seedId;
+	/* owning arena (see arena.h) or NULL if allocated with calloc; strings
+	 * above live in the same arena then */
+	void *arena;
 } PianoStation_t;
 
 typedef enum {
@@ -98,6 +101,11 @@ typedef struct PianoSong {
 	unsigned int length; /* song length in seconds */
 	PianoSongRating_t rating;
 	PianoAudioFormat_t audioFormat;
+	/* owning arena (see arena.h) or NULL if allocated with calloc */
+	void *arena;
+	/* interning pool (see intern.h) artist/album/stationId/detailUrl are
+	 * shared through, or NULL if they are owned by this song */
+	void *intern;
 } PianoSong_t;
 
 /* currently only used for search results */
@@ -134,6 +142,9 @@ typedef struct PianoHandle {
 	PianoGenreCategory_t *genreStations;
 	PianoPartner_t partner;
 	int timeOffset;
+	/* string interning pool (see intern.h), shared by all songs parsed
+	 * through this handle; destroy all playlists before the handle */
+	void *intern;
 } PianoHandle_t;
 
 typedef struct PianoSearchResult {
@@ -179,6 +190,10 @@ typedef struct PianoRequest {
 	char urlPath[1024];
 	char *postData;
 	char *responseData;
+	/* streaming parse state (json-c tokener/object), fed by
+	 * PianoResponseFeed as an alternative to buffering responseData */
+	void *responseTokener;
+	void *responseObj;
 } PianoRequest_t;
 
 /* request data structures */
@@ -326,12 +341,29 @@ void *PianoListGet (PianoListHead_t * const l, const size_t n);
 #define PianoListGetP(l,n) PianoListGet (&(l)->head, n)
 #define PianoListForeachP(l) for (; (l) != NULL; (l) = (void *) (l)->head.next)
 
+/* list container carrying tail pointer and cached count, so appending N
+ * elements while assembling a response is O(N) instead of O(N²); the head
+ * stays an ordinary singly-linked list, PianoListForeachP et al. keep
+ * working on it */
+typedef struct PianoList {
+	PianoListHead_t *head, *tail;
+	size_t count;
+} PianoList_t;
+
+void PianoListInit (PianoList_t * const, PianoListHead_t * const);
+#define PianoListInitP(list,l) PianoListInit (list, \
+		((l) == NULL) ? NULL : &(l)->head)
+void PianoListPush (PianoList_t * const, PianoListHead_t * const);
+#define PianoListPushP(list,e) PianoListPush (list, &(e)->head)
+#define PianoListHeadP(list) ((void *) (list)->head)
+
 /* memory management */
 PianoReturn_t PianoInit (PianoHandle_t *, const char *,
 		const char *, const char *, const char *,
 		const char *);
 void PianoDestroy (PianoHandle_t *);
 void PianoDestroyPlaylist (PianoSong_t *);
+void PianoDestroyStations (PianoStation_t *);
 void PianoDestroySearchResult (PianoSearchResult_t *);
 void PianoDestroyStationInfo (PianoStationInfo_t *);
 
@@ -339,6 +371,7 @@ void PianoDestroyStationInfo (PianoStationInfo_t *);
 PianoReturn_t PianoRequest (PianoHandle_t *, PianoRequest_t *,
 		PianoRequestType_t);
 PianoReturn_t PianoResponse (PianoHandle_t *, PianoRequest_t *);
+PianoReturn_t PianoResponseFeed (PianoRequest_t *, const char *, size_t);
 void PianoDestroyRequest (PianoRequest_t *);
 
 /* misc */
@@ -36,6 +36,147 @@ THE SOFTWARE.
 #include "piano.h"
 #include "crypt.h"
 
+/*	append a string to the buffer
+ *	@return false if the buffer is too small
+ */
+static bool PianoBufAppend (char *buf, size_t size, size_t *off,
+		const char *in) {
+	const size_t len = strlen (in);
+
+	if (*off + len >= size) {
+		return false;
+	}
+	memcpy (buf + *off, in, len + 1);
+	*off += len;
+	return true;
+}
+
+/*	append a json-escaped string value to the buffer
+ *	@return false if the buffer is too small
+ */
+static bool PianoBufAppendEscaped (char *buf, size_t size, size_t *off,
+		const char *in) {
+	for (; *in != '\0'; in++) {
+		const unsigned char c = (unsigned char) *in;
+
+		if (c == '"' || c == '\\') {
+			if (*off + 2 >= size) {
+				return false;
+			}
+			buf[(*off)++] = '\\';
+			buf[(*off)++] = c;
+		} else if (c < 0x20) {
+			if (*off + 6 >= size) {
+				return false;
+			}
+			*off += snprintf (buf + *off, size - *off, "\\u%04x", c);
+		} else {
+			if (*off + 1 >= size) {
+				return false;
+			}
+			buf[(*off)++] = c;
+		}
+	}
+	buf[*off] = '\0';
+	return true;
+}
+
+/*	serialize the hot, fixed-shape requests straight into a stack buffer
+ *	and encrypt from there; the json-c object tree, its serialization and
+ *	the intermediate copies are skipped entirely. request layouts are
+ *	compile-time constant per type, only the field values vary.
+ *	@return false for types without a direct layout (or if the buffer ran
+ *		out), the generic json-c path handles those
+ */
+static bool PianoRequestDirect (PianoHandle_t *ph, PianoRequest_t *req,
+		time_t timestamp, PianoReturn_t *ret) {
+	char json[2048], timeBuf[32], *urlencAuthToken;
+	size_t off = 0;
+	const char *method;
+	bool ok;
+
+	switch (req->type) {
+		case PIANO_REQUEST_ADD_FEEDBACK: {
+			PianoRequestDataAddFeedback_t *reqData = req->data;
+
+			assert (reqData != NULL);
+			assert (reqData->trackToken != NULL);
+			assert (reqData->stationId != NULL);
+			assert (reqData->rating != PIANO_RATE_NONE);
+
+			ok = PianoBufAppend (json, sizeof (json), &off,
+							"{\"stationToken\":\"") &&
+					PianoBufAppendEscaped (json, sizeof (json), &off,
+							reqData->stationId) &&
+					PianoBufAppend (json, sizeof (json), &off,
+							"\",\"trackToken\":\"") &&
+					PianoBufAppendEscaped (json, sizeof (json), &off,
+							reqData->trackToken) &&
+					PianoBufAppend (json, sizeof (json), &off,
+							reqData->rating == PIANO_RATE_LOVE ?
+							"\",\"isPositive\":true" :
+							"\",\"isPositive\":false");
+
+			method = "station.addFeedback";
+			break;
+		}
+
+		case PIANO_REQUEST_GET_PLAYLIST: {
+			PianoRequestDataGetPlaylist_t *reqData = req->data;
+
+			assert (reqData != NULL);
+			assert (reqData->station != NULL);
+			assert (reqData->station->id != NULL);
+
+			req->secure = true;
+
+			ok = PianoBufAppend (json, sizeof (json), &off,
+							"{\"stationToken\":\"") &&
+					PianoBufAppendEscaped (json, sizeof (json), &off,
+							reqData->station->id) &&
+					PianoBufAppend (json, sizeof (json), &off,
+							"\",\"includeTrackLength\":true");
+
+			method = "station.getPlaylist";
+			break;
+		}
+
+		default:
+			return false;
+	}
+
+	/* standard parameters, same for every authenticated method call */
+	assert (ph->user.authToken != NULL);
+	assert (ph->user.listenerId != NULL);
+
+	snprintf (timeBuf, sizeof (timeBuf), "%lu", (unsigned long) timestamp);
+	ok = ok && PianoBufAppend (json, sizeof (json), &off,
+					",\"userAuthToken\":\"") &&
+			PianoBufAppendEscaped (json, sizeof (json), &off,
+					ph->user.authToken) &&
+			PianoBufAppend (json, sizeof (json), &off, "\",\"syncTime\":") &&
+			PianoBufAppend (json, sizeof (json), &off, timeBuf) &&
+			PianoBufAppend (json, sizeof (json), &off, "}");
+	if (!ok) {
+		/* does not fit, let the generic path build it */
+		return false;
+	}
+
+	urlencAuthToken = WaitressUrlEncode (ph->user.authToken);
+	assert (urlencAuthToken != NULL);
+	snprintf (req->urlPath, sizeof (req->urlPath), PIANO_RPC_PATH
+			"method=%s&auth_token=%s&partner_id=%i&user_id=%s", method,
+			urlencAuthToken, ph->partner.id, ph->user.listenerId);
+	free (urlencAuthToken);
+
+	if ((req->postData = PianoEncryptString (ph->partner.out,
+			json)) == NULL) {
+		*ret = PIANO_RET_OUT_OF_MEMORY;
+	}
+
+	return true;
+}
+
 /*	prepare piano request (initializes request type, urlpath and postData)
  *	@param piano handle
  *	@param request structure
@@ -46,7 +187,7 @@ PianoReturn_t PianoRequest (PianoHandle_t *ph, PianoRequest_t *req,
 	PianoReturn_t ret = PIANO_RET_OK;
 	const char *jsonSendBuf;
 	const char *method = NULL;
-	json_object *j = json_object_new_object ();
+	json_object *j;
 	/* corrected timestamp */
 	time_t timestamp = time (NULL) - ph->timeOffset;
 	bool encrypted = true;
@@ -58,6 +199,13 @@ PianoReturn_t PianoRequest (PianoHandle_t *ph, PianoRequest_t *req,
 	/* no tls by default */
 	req->secure = false;
 
+	/* hot fixed-shape requests skip the json-c tree entirely */
+	if (PianoRequestDirect (ph, req, timestamp, &ret)) {
+		return ret;
+	}
+
+	j = json_object_new_object ();
+
 	switch (req->type) {
 		case PIANO_REQUEST_LOGIN: {
 			/* authenticate user */
@@ -35,14 +35,32 @@ THE SOFTWARE.
 #include "piano.h"
 #include "piano_private.h"
 #include "crypt.h"
+#include "arena.h"
+#include "intern.h"
 
 static char *PianoJsonStrdup (json_object *j, const char *key) {
 	return strdup (json_object_get_string (json_object_object_get (j, key)));
 }
 
-static void PianoJsonParseStation (json_object *j, PianoStation_t *s) {
-	s->name = PianoJsonStrdup (j, "stationName");
-	s->id = PianoJsonStrdup (j, "stationToken");
+/*	like PianoJsonStrdup, but the copy lives in the arena */
+static char *PianoJsonArenaStrdup (PianoArena_t *arena, json_object *j,
+		const char *key) {
+	return PianoArenaStrdup (arena,
+			json_object_get_string (json_object_object_get (j, key)));
+}
+
+/*	like PianoJsonStrdup, but the string is shared through the interning
+ *	pool; the caller holds one reference */
+static char *PianoJsonInternStrdup (PianoIntern_t *intern, json_object *j,
+		const char *key) {
+	return PianoInternGet (intern,
+			json_object_get_string (json_object_object_get (j, key)));
+}
+
+static void PianoJsonParseStation (PianoArena_t *arena, json_object *j,
+		PianoStation_t *s) {
+	s->name = PianoJsonArenaStrdup (arena, j, "stationName");
+	s->id = PianoJsonArenaStrdup (arena, j, "stationToken");
 	s->isCreator = !json_object_get_boolean (json_object_object_get (j,
 			"isShared"));
 	s->isQuickMix = json_object_get_boolean (json_object_object_get (j,
@@ -73,10 +91,40 @@ static void PianoStrpcat (char * restrict dest, const char * restrict src,
 	*dest = '\0';
 }
 
+/*	feed a chunk of the response into a streaming json parser; parsing
+ *	overlaps the download and no intermediate response copy is required
+ *	@param initialized request
+ *	@param response chunk
+ *	@param chunk size
+ */
+PianoReturn_t PianoResponseFeed (PianoRequest_t *req, const char *data,
+		size_t size) {
+	json_object *obj;
+
+	assert (req != NULL);
+	assert (data != NULL);
+
+	if (req->responseTokener == NULL) {
+		if ((req->responseTokener = json_tokener_new ()) == NULL) {
+			return PIANO_RET_OUT_OF_MEMORY;
+		}
+	}
+
+	obj = json_tokener_parse_ex (req->responseTokener, data, size);
+	if (obj != NULL) {
+		req->responseObj = obj;
+	} else if (json_tokener_get_error (req->responseTokener) !=
+			json_tokener_continue) {
+		return PIANO_RET_INVALID_RESPONSE;
+	}
+
+	return PIANO_RET_OK;
+}
+
 /*	parse xml response and update data structures/return new data structure
  *	@param piano handle
  *	@param initialized request (expects responseData to be a NUL-terminated
- *			string)
+ *			string or the response to have been fed into PianoResponseFeed)
  */
 PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 	PianoReturn_t ret = PIANO_RET_OK;
@@ -85,7 +133,18 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 	assert (ph != NULL);
 	assert (req != NULL);
 
-	j = json_tokener_parse (req->responseData);
+	if (req->responseObj != NULL) {
+		/* parsed incrementally while the response was received; ownership
+		 * moves to us, it is put below */
+		j = req->responseObj;
+		req->responseObj = NULL;
+	} else {
+		j = req->responseData != NULL ?
+				json_tokener_parse (req->responseData) : NULL;
+	}
+	if (j == NULL) {
+		return PIANO_RET_INVALID_RESPONSE;
+	}
 
 	status = json_object_object_get (j, "stat");
 	if (status == NULL) {
@@ -124,7 +183,7 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 			/* authenticate user */
 			PianoRequestDataLogin_t *reqData = req->data;
 
-			assert (req->responseData != NULL);
+			assert (j != NULL);
 			assert (reqData != NULL);
 
 			switch (reqData->step) {
@@ -173,20 +232,34 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 
 		case PIANO_REQUEST_GET_STATIONS: {
 			/* get stations */
-			assert (req->responseData != NULL);
+			assert (j != NULL);
 
 			json_object *stations = json_object_object_get (result,
 					"stations"), *mix = NULL;
+			PianoArena_t *arena;
+			PianoList_t stationList;
+
+			PianoListInitP (&stationList, ph->stations);
+
+			/* all stations of this response share one arena; every station
+			 * holds a reference, the last one destroyed frees the arena */
+			if ((arena = PianoArenaCreate ()) == NULL) {
+				return PIANO_RET_OUT_OF_MEMORY;
+			}
 
 			for (int i = 0; i < json_object_array_length (stations); i++) {
 				PianoStation_t *tmpStation;
 				json_object *s = json_object_array_get_idx (stations, i);
 
-				if ((tmpStation = calloc (1, sizeof (*tmpStation))) == NULL) {
+				if ((tmpStation = PianoArenaCalloc (arena,
+						sizeof (*tmpStation))) == NULL) {
+					PianoArenaUnref (arena);
 					return PIANO_RET_OUT_OF_MEMORY;
 				}
 
-				PianoJsonParseStation (s, tmpStation);
+				PianoJsonParseStation (arena, s, tmpStation);
+				tmpStation->arena = arena;
+				PianoArenaRef (arena);
 
 				if (tmpStation->isQuickMix) {
 					/* fix flags on other stations later */
@@ -194,9 +267,13 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 				}
 
 				/* start new linked list or append */
-				ph->stations = PianoListAppendP (ph->stations, tmpStation);
+				PianoListPushP (&stationList, tmpStation);
 			}
 
+			/* drop creation reference, the stations keep theirs */
+			PianoArenaUnref (arena);
+			ph->stations = PianoListHeadP (&stationList);
+
 			/* fix quickmix flags */
 			if (mix != NULL) {
 				PianoStation_t *curStation = ph->stations;
@@ -216,25 +293,35 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 		case PIANO_REQUEST_GET_PLAYLIST: {
 			/* get playlist, usually four songs */
 			PianoRequestDataGetPlaylist_t *reqData = req->data;
-			PianoSong_t *playlist = NULL;
+			PianoList_t playlist;
+			PianoArena_t *arena;
+
+			PianoListInit (&playlist, NULL);
 
-			assert (req->responseData != NULL);
+			assert (j != NULL);
 			assert (reqData != NULL);
 			assert (reqData->quality != PIANO_AQ_UNKNOWN);
 
 			json_object *items = json_object_object_get (result, "items");
 			assert (items != NULL);
 
+			/* the playlist's songs share one arena, see GET_STATIONS */
+			if ((arena = PianoArenaCreate ()) == NULL) {
+				return PIANO_RET_OUT_OF_MEMORY;
+			}
+
 			for (int i = 0; i < json_object_array_length (items); i++) {
 				json_object *s = json_object_array_get_idx (items, i);
 				PianoSong_t *song;
 
-				if ((song = calloc (1, sizeof (*song))) == NULL) {
+				if ((song = PianoArenaCalloc (arena, sizeof (*song))) == NULL) {
+					PianoDestroyPlaylist (PianoListHeadP (&playlist));
+					PianoArenaUnref (arena);
 					return PIANO_RET_OUT_OF_MEMORY;
 				}
 
 				if (json_object_object_get (s, "artistName") == NULL) {
-					free (song);
+					/* song stays in the arena, but it is never referenced */
 					continue;
 				}
 
@@ -259,23 +346,31 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 								break;
 							}
 						}
-						song->audioUrl = PianoJsonStrdup (map, "audioUrl");
+						song->audioUrl = PianoJsonArenaStrdup (arena, map,
+								"audioUrl");
 					} else {
 						/* requested quality is not available */
 						ret = PIANO_RET_QUALITY_UNAVAILABLE;
-						free (song);
-						PianoDestroyPlaylist (playlist);
+						PianoDestroyPlaylist (PianoListHeadP (&playlist));
+						PianoArenaUnref (arena);
 						goto cleanup;
 					}
 				}
 
-				song->artist = PianoJsonStrdup (s, "artistName");
-				song->album = PianoJsonStrdup (s, "albumName");
-				song->title = PianoJsonStrdup (s, "songName");
-				song->trackToken = PianoJsonStrdup (s, "trackToken");
-				song->stationId = PianoJsonStrdup (s, "stationId");
-				song->coverArt = PianoJsonStrdup (s, "albumArtUrl");
-				song->detailUrl = PianoJsonStrdup (s, "songDetailUrl");
+				/* artist/album/station/detail strings recur across songs
+				 * and playlists, share them through the interning pool */
+				song->intern = ph->intern;
+				song->artist = PianoJsonInternStrdup (ph->intern, s,
+						"artistName");
+				song->album = PianoJsonInternStrdup (ph->intern, s,
+						"albumName");
+				song->title = PianoJsonArenaStrdup (arena, s, "songName");
+				song->trackToken = PianoJsonArenaStrdup (arena, s, "trackToken");
+				song->stationId = PianoJsonInternStrdup (ph->intern, s,
+						"stationId");
+				song->coverArt = PianoJsonArenaStrdup (arena, s, "albumArtUrl");
+				song->detailUrl = PianoJsonInternStrdup (ph->intern, s,
+						"songDetailUrl");
 				song->fileGain = json_object_get_double (
 						json_object_object_get (s, "trackGain"));
 				song->length = json_object_get_int (
@@ -287,10 +382,14 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 						break;
 				}
 
-				playlist = PianoListAppendP (playlist, song);
+				song->arena = arena;
+				PianoArenaRef (arena);
+				PianoListPushP (&playlist, song);
 			}
 
-			reqData->retPlaylist = playlist;
+			/* drop creation reference, the songs keep theirs */
+			PianoArenaUnref (arena);
+			reqData->retPlaylist = PianoListHeadP (&playlist);
 			break;
 		}
 
@@ -314,8 +413,15 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 			assert (reqData->station != NULL);
 			assert (reqData->newName != NULL);
 
-			free (reqData->station->name);
-			reqData->station->name = strdup (reqData->newName);
+			if (reqData->station->arena != NULL) {
+				/* the old name stays in the arena until the station is
+				 * destroyed */
+				reqData->station->name = PianoArenaStrdup (
+						reqData->station->arena, reqData->newName);
+			} else {
+				free (reqData->station->name);
+				reqData->station->name = strdup (reqData->newName);
+			}
 			break;
 		}
 
@@ -326,8 +432,11 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 			assert (station != NULL);
 
 			ph->stations = PianoListDeleteP (ph->stations, station);
+			const bool fromArena = station->arena != NULL;
 			PianoDestroyStation (station);
-			free (station);
+			if (!fromArena) {
+				free (station);
+			}
 			break;
 		}
 
@@ -336,7 +445,7 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 			PianoRequestDataSearch_t *reqData = req->data;
 			PianoSearchResult_t *searchResult;
 
-			assert (req->responseData != NULL);
+			assert (j != NULL);
 			assert (reqData != NULL);
 
 			searchResult = &reqData->searchResult;
@@ -386,19 +495,30 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 		case PIANO_REQUEST_CREATE_STATION: {
 			/* create station, insert new station into station list on success */
 			PianoStation_t *tmpStation;
+			PianoArena_t *arena;
 
-			if ((tmpStation = calloc (1, sizeof (*tmpStation))) == NULL) {
+			if ((arena = PianoArenaCreate ()) == NULL) {
+				return PIANO_RET_OUT_OF_MEMORY;
+			}
+			if ((tmpStation = PianoArenaCalloc (arena,
+					sizeof (*tmpStation))) == NULL) {
+				PianoArenaUnref (arena);
 				return PIANO_RET_OUT_OF_MEMORY;
 			}
 
-			PianoJsonParseStation (result, tmpStation);
+			PianoJsonParseStation (arena, result, tmpStation);
+			/* the creation reference becomes the station's */
+			tmpStation->arena = arena;
 
 			PianoStation_t *search = PianoFindStationById (ph->stations,
 					tmpStation->id);
 			if (search != NULL) {
 				ph->stations = PianoListDeleteP (ph->stations, search);
+				const bool fromArena = search->arena != NULL;
 				PianoDestroyStation (search);
-				free (search);
+				if (!fromArena) {
+					free (search);
+				}
 			}
 			ph->stations = PianoListAppendP (ph->stations, tmpStation);
 			break;
@@ -418,6 +538,10 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 			/* get genre stations */
 			json_object *categories = json_object_object_get (result, "categories");
 			if (categories != NULL) {
+				PianoList_t categoryList;
+
+				PianoListInitP (&categoryList, ph->genreStations);
+
 				for (int i = 0; i < json_object_array_length (categories); i++) {
 					json_object *c = json_object_array_get_idx (categories, i);
 					PianoGenreCategory_t *tmpGenreCategory;
@@ -434,6 +558,10 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 					json_object *stations = json_object_object_get (c,
 							"stations");
 					if (stations != NULL) {
+						PianoList_t genreList;
+
+						PianoListInit (&genreList, NULL);
+
 						for (int k = 0;
 								k < json_object_array_length (stations); k++) {
 							json_object *s =
@@ -451,15 +579,16 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 							tmpGenre->musicId = PianoJsonStrdup (s,
 									"stationToken");
 
-							tmpGenreCategory->genres =
-									PianoListAppendP (tmpGenreCategory->genres,
-									tmpGenre);
+							PianoListPushP (&genreList, tmpGenre);
 						}
+
+						tmpGenreCategory->genres = PianoListHeadP (&genreList);
 					}
 
-					ph->genreStations = PianoListAppendP (ph->genreStations,
-							tmpGenreCategory);
+					PianoListPushP (&categoryList, tmpGenreCategory);
 				}
+
+				ph->genreStations = PianoListHeadP (&categoryList);
 			}
 			break;
 		}
@@ -468,7 +597,7 @@ PianoReturn_t PianoResponse (PianoHandle_t *ph, PianoRequest_t *req) {
 			/* transform shared station into private and update isCreator flag */
 			PianoStation_t *station = req->data;
 
-			assert (req->responseData != NULL);
+			assert (j != NULL);
 			assert (station != NULL);
 
 			station->isCreator = 1;
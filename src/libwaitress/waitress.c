@@ -40,6 +40,7 @@ THE SOFTWARE.
 #include <errno.h>
 #include <assert.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <gnutls/x509.h>
 
@@ -52,6 +53,11 @@ THE SOFTWARE.
 typedef struct {
 	char *data;
 	size_t pos;
+	/* allocated buffer size, grown geometrically if the response size is
+	 * not known up front */
+	size_t allocated;
+	/* handle the fetch runs on, exposes the parsed Content-Length */
+	const WaitressHandle_t *waith;
 } WaitressFetchBufCbBuffer_t;
 
 static WaitressReturn_t WaitressReceiveHeaders (WaitressHandle_t *, size_t *);
@@ -67,16 +73,61 @@ static WaitressReturn_t WaitressReceiveHeaders (WaitressHandle_t *, size_t *);
 			return wRet; \
 		}
 
+#define APPEND_RET(data, size) \
+		if ((wRet = WaitressBufferedWrite (waith, &off, data, size)) != \
+				WAITRESS_RET_OK) { \
+			return wRet; \
+		}
+
 void WaitressInit (WaitressHandle_t *waith) {
 	assert (waith != NULL);
 
 	memset (waith, 0, sizeof (*waith));
 	waith->timeout = 30000;
+	waith->bufferSize = WAITRESS_BUFFER_SIZE;
+	for (size_t i = 0; i < sizeof (waith->conn) / sizeof (*waith->conn); i++) {
+		waith->conn[i].sockfd = -1;
+	}
+}
+
+/*	tear down a persistent connection; cached tls session data survives, so
+ *	the next handshake can be resumed
+ */
+static void WaitressDisconnect (WaitressConnection_t * const conn) {
+	assert (conn != NULL);
+
+	if (conn->tlsSessionValid) {
+		gnutls_deinit (conn->tlsSession);
+		conn->tlsSessionValid = false;
+	}
+	if (conn->sockfd != -1) {
+		close (conn->sockfd);
+		conn->sockfd = -1;
+	}
+}
+
+/*	persistent connection for the current url (plain http or tls)
+ */
+static WaitressConnection_t *WaitressActiveConnection (
+		WaitressHandle_t *waith) {
+	return &waith->conn[waith->url.tls ? 1 : 0];
 }
 
 void WaitressFree (WaitressHandle_t *waith) {
 	assert (waith != NULL);
 
+	for (size_t i = 0; i < sizeof (waith->conn) / sizeof (*waith->conn); i++) {
+		WaitressDisconnect (&waith->conn[i]);
+		if (waith->conn[i].tlsResumeData.data != NULL) {
+			gnutls_free (waith->conn[i].tlsResumeData.data);
+		}
+	}
+	if (waith->tlsCredValid) {
+		gnutls_certificate_free_credentials (waith->tlsCred);
+	}
+	if (waith->dnsCache != NULL) {
+		freeaddrinfo (waith->dnsCache);
+	}
 	free (waith->url.url);
 	free (waith->proxy.url);
 	memset (waith, 0, sizeof (*waith));
@@ -377,20 +428,38 @@ static WaitressCbReturn_t WaitressFetchBufCb (void *recvData, size_t recvDataSiz
 	char *recvBytes = recvData;
 	WaitressFetchBufCbBuffer_t *buffer = extraData;
 
-	if (buffer->data == NULL) {
-		if ((buffer->data = malloc (sizeof (*buffer->data) *
-				(recvDataSize + 1))) == NULL) {
-			return WAITRESS_CB_RET_ERR;
-		}
-	} else {
+	if (buffer->pos + recvDataSize + 1 > buffer->allocated) {
 		char *newbuf;
+		size_t newSize;
+
+		if (buffer->data == NULL &&
+				buffer->waith->request.contentLengthKnown &&
+				!buffer->waith->request.contentEncodingGzip) {
+			/* the body size is known up front, allocate it in one go;
+			 * content-length is the compressed size for encoded bodies,
+			 * those grow geometrically below */
+			newSize = buffer->waith->request.contentLength + 1;
+			if (newSize < recvDataSize + 1) {
+				newSize = recvDataSize + 1;
+			}
+		} else {
+			/* chunked response: grow geometrically, so the number of
+			 * reallocs/copies is logarithmic in the response size */
+			newSize = buffer->allocated == 0 ? WAITRESS_BUFFER_SIZE :
+					buffer->allocated * 2;
+			while (newSize < buffer->pos + recvDataSize + 1) {
+				newSize *= 2;
+			}
+		}
+
 		if ((newbuf = realloc (buffer->data,
-				sizeof (*buffer->data) *
-				(buffer->pos + recvDataSize + 1))) == NULL) {
+				sizeof (*buffer->data) * newSize)) == NULL) {
 			free (buffer->data);
+			buffer->data = NULL;
 			return WAITRESS_CB_RET_ERR;
 		}
 		buffer->data = newbuf;
+		buffer->allocated = newSize;
 	}
 	memcpy (buffer->data + buffer->pos, recvBytes, recvDataSize);
 	buffer->pos += recvDataSize;
@@ -412,6 +481,7 @@ WaitressReturn_t WaitressFetchBuf (WaitressHandle_t *waith, char **retBuffer) {
 	assert (retBuffer != NULL);
 
 	memset (&buffer, 0, sizeof (buffer));
+	buffer.waith = waith;
 
 	waith->data = &buffer;
 	waith->callback = WaitressFetchBufCb;
@@ -611,6 +681,52 @@ static char *WaitressGetline (char * const str) {
 	return eol;
 }
 
+/*	inflate gzip/deflate encoded body, passing the decompressed data to the
+ *	callback
+ */
+static WaitressHandlerReturn_t WaitressInflate (WaitressHandle_t *waith,
+		char *buf, const size_t size) {
+	z_stream * const zs = &waith->request.gzipStream;
+
+	if (!waith->request.gzipInitialized) {
+		memset (zs, 0, sizeof (*zs));
+		/* 15+32: zlib autodetects gzip and deflate wrapping */
+		if (inflateInit2 (zs, 15+32) != Z_OK) {
+			return WAITRESS_HANDLER_ERR;
+		}
+		waith->request.gzipInitialized = true;
+	}
+
+	zs->next_in = (unsigned char *) buf;
+	zs->avail_in = size;
+	/* standard zlib drain loop: repeat until inflate leaves room in the
+	 * output buffer; zlib may buffer decompressed data internally even
+	 * after the input is consumed */
+	do {
+		unsigned char outBuf[WAITRESS_BUFFER_SIZE];
+		zs->next_out = outBuf;
+		zs->avail_out = sizeof (outBuf);
+
+		const int zret = inflate (zs, Z_NO_FLUSH);
+		if (zret != Z_OK && zret != Z_STREAM_END) {
+			return WAITRESS_HANDLER_ERR;
+		}
+
+		const size_t decoded = sizeof (outBuf) - zs->avail_out;
+		if (decoded > 0 && waith->callback ((char *) outBuf, decoded,
+				waith->data) == WAITRESS_CB_RET_ERR) {
+			return WAITRESS_HANDLER_ABORTED;
+		}
+		if (zret == Z_STREAM_END) {
+			/* checked at end of body, see WaitressReceiveResponse */
+			waith->request.gzipStreamEnd = true;
+			break;
+		}
+	} while (zs->avail_out == 0);
+
+	return WAITRESS_HANDLER_CONTINUE;
+}
+
 /*	identity encoding handler
  */
 static WaitressHandlerReturn_t WaitressHandleIdentity (void *data, char *buf,
@@ -621,6 +737,9 @@ static WaitressHandlerReturn_t WaitressHandleIdentity (void *data, char *buf,
 	WaitressHandle_t *waith = data;
 
 	waith->request.contentReceived += size;
+	if (waith->request.contentEncodingGzip) {
+		return WaitressInflate (waith, buf, size);
+	}
 	if (waith->callback (buf, size, waith->data) == WAITRESS_CB_RET_ERR) {
 		return WAITRESS_HANDLER_ABORTED;
 	} else {
@@ -640,29 +759,43 @@ static WaitressHandlerReturn_t WaitressHandleChunked (void *data, char *buf,
 
 	while (pos < size) {
 		switch (waith->request.chunkedState) {
-			case CHUNKSIZE:
+			case CHUNKSIZE: {
+				/* find the end of the size line first, then parse the whole
+				 * hex number in one go instead of re-entering the state
+				 * machine for every byte; a line split across two reads
+				 * simply resumes here with the partial value kept in
+				 * chunkSize */
+				const char * const eol = memchr (&buf[pos], '\n', size - pos);
+				const size_t lineEnd = eol == NULL ? size :
+						(size_t) (eol - buf);
 				/* Poor man’s hex to integer. This avoids another buffer that
 				 * fills until the terminating \r\n is received. */
-				if (buf[pos] >= '0' && buf[pos] <= '9') {
-					waith->request.chunkSize <<= 4;
-					waith->request.chunkSize |= buf[pos] & 0xf;
-				} else if (buf[pos] >= 'a' && buf[pos] <= 'f') {
-					waith->request.chunkSize <<= 4;
-					waith->request.chunkSize |= (buf[pos]+9) & 0xf;
-				} else if (buf[pos] == '\r') {
-					/* ignore */
-				} else if (buf[pos] == '\n') {
-					waith->request.chunkedState = DATA;
-					/* last chunk has size 0 */
-					if (waith->request.chunkSize == 0) {
-						return WAITRESS_HANDLER_DONE;
+				for (; pos < lineEnd; pos++) {
+					if (buf[pos] >= '0' && buf[pos] <= '9') {
+						waith->request.chunkSize <<= 4;
+						waith->request.chunkSize |= buf[pos] & 0xf;
+					} else if (buf[pos] >= 'a' && buf[pos] <= 'f') {
+						waith->request.chunkSize <<= 4;
+						waith->request.chunkSize |= (buf[pos]+9) & 0xf;
+					} else if (buf[pos] == '\r') {
+						/* ignore */
+					} else {
+						/* everything else is a protocol violation */
+						return WAITRESS_HANDLER_ERR;
 					}
-				} else {
-					/* everything else is a protocol violation */
-					return WAITRESS_HANDLER_ERR;
+				}
+				if (eol == NULL) {
+					/* size line continues in the next read */
+					return WAITRESS_HANDLER_CONTINUE;
 				}
 				++pos;
+				waith->request.chunkedState = DATA;
+				/* last chunk has size 0 */
+				if (waith->request.chunkSize == 0) {
+					return WAITRESS_HANDLER_DONE;
+				}
 				break;
+			}
 
 			case DATA:
 				if (waith->request.chunkSize > 0) {
@@ -708,6 +841,14 @@ static void WaitressHandleHeader (WaitressHandle_t *waith, const char * const ke
 		if (strcaseeq (value, "chunked")) {
 			waith->request.dataHandler = WaitressHandleChunked;
 		}
+	} else if (strcaseeq (key, "Content-Encoding")) {
+		if (strcaseeq (value, "gzip") || strcaseeq (value, "deflate")) {
+			waith->request.contentEncodingGzip = true;
+		}
+	} else if (strcaseeq (key, "Connection")) {
+		if (strcaseeq (value, "close")) {
+			waith->request.connectionClose = true;
+		}
 	}
 }
 
@@ -767,80 +908,227 @@ static WaitressReturn_t WaitressTlsVerify (const WaitressHandle_t *waith) {
 	return WAITRESS_RET_OK;
 }
 
-/*	Connect to server
+/* reuse resolved addresses for this many seconds; getaddrinfo does not
+ * expose the record ttl, so a short fixed lifetime has to do */
+#define WAITRESS_DNS_CACHE_LIFETIME 60
+
+/* race at most this many addresses in parallel */
+#define WAITRESS_CONNECT_PARALLEL 8
+
+/*	drop cached dns entries
  */
-static WaitressReturn_t WaitressConnect (WaitressHandle_t *waith) {
-	WaitressReturn_t ret;
-	struct addrinfo hints, *gares;
+static void WaitressDnsInvalidate (WaitressHandle_t *waith) {
+	if (waith->dnsCache != NULL) {
+		freeaddrinfo (waith->dnsCache);
+		waith->dnsCache = NULL;
+	}
+}
+
+/*	resolve host/port, serving repeated lookups from a small positive cache
+ *	@param waitress handle
+ *	@param host
+ *	@param port
+ *	@param result, owned by the cache, do _not_ freeaddrinfo it
+ *	@param set iff the result came from the cache
+ */
+static WaitressReturn_t WaitressResolve (WaitressHandle_t *waith,
+		const char *host, const char *port, struct addrinfo **gares,
+		bool *fromCache) {
+	struct addrinfo hints;
+	const time_t now = time (NULL);
+
+	if (waith->dnsCache != NULL && now < waith->dnsCacheExpires &&
+			strcmp (waith->dnsCacheHost, host) == 0 &&
+			strcmp (waith->dnsCachePort, port) == 0) {
+		*gares = waith->dnsCache;
+		*fromCache = true;
+		return WAITRESS_RET_OK;
+	}
+
+	WaitressDnsInvalidate (waith);
 
 	memset (&hints, 0, sizeof hints);
 
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_STREAM;
 
-	/* Use proxy? */
-	if (WaitressProxyEnabled (waith)) {
-		if (getaddrinfo (waith->proxy.host,
-				WaitressDefaultPort (&waith->proxy), &hints, &gares) != 0) {
-			return WAITRESS_RET_GETADDR_ERR;
-		}
-	} else {
-		if (getaddrinfo (waith->url.host,
-				WaitressDefaultPort (&waith->url), &hints, &gares) != 0) {
-			return WAITRESS_RET_GETADDR_ERR;
-		}
+	if (getaddrinfo (host, port, &hints, gares) != 0) {
+		return WAITRESS_RET_GETADDR_ERR;
 	}
 
-	/* try all addresses */
-	for (struct addrinfo *gacurr = gares; gacurr != NULL;
-			gacurr = gacurr->ai_next) {
-		int sock = -1;
+	waith->dnsCache = *gares;
+	snprintf (waith->dnsCacheHost, sizeof (waith->dnsCacheHost), "%s", host);
+	snprintf (waith->dnsCachePort, sizeof (waith->dnsCachePort), "%s", port);
+	waith->dnsCacheExpires = now + WAITRESS_DNS_CACHE_LIFETIME;
+	*fromCache = false;
+
+	return WAITRESS_RET_OK;
+}
+
+/*	start a non-blocking connect to every address and keep whichever socket
+ *	wins the race (happy eyeballs); a broken route on one address family
+ *	does not stall the other one anymore
+ */
+static WaitressReturn_t WaitressConnectRace (WaitressHandle_t *waith,
+		const struct addrinfo *gares) {
+	struct pollfd sockets[WAITRESS_CONNECT_PARALLEL];
+	nfds_t count = 0;
+	int winner = -1;
+	WaitressReturn_t ret = WAITRESS_RET_SOCK_ERR;
 
-		ret = WAITRESS_RET_OK;
+	for (const struct addrinfo *gacurr = gares; gacurr != NULL &&
+			count < WAITRESS_CONNECT_PARALLEL; gacurr = gacurr->ai_next) {
+		int sock;
 
 		if ((sock = socket (gacurr->ai_family, gacurr->ai_socktype,
 				gacurr->ai_protocol)) == -1) {
-			ret = WAITRESS_RET_SOCK_ERR;
-		} else {
-			int pollres;
-
-			/* we need shorter timeouts for connect() */
-			fcntl (sock, F_SETFL, O_NONBLOCK);
-
-			/* non-blocking connect will return immediately */
-			connect (sock, gacurr->ai_addr, gacurr->ai_addrlen);
-
-			pollres = WaitressPollLoop (sock, POLLOUT, waith->timeout);
-			if (pollres == 0) {
-				ret = WAITRESS_RET_TIMEOUT;
-			} else if (pollres == -1) {
-				ret = WAITRESS_RET_ERR;
-			} else {
-				/* check connect () return value */
-				socklen_t pollresSize = sizeof (pollres);
-				getsockopt (sock, SOL_SOCKET, SO_ERROR, &pollres,
-						&pollresSize);
-				if (pollres != 0) {
-					ret = WAITRESS_RET_CONNECT_REFUSED;
-				} else {
-					/* this one is working */
-					waith->request.sockfd = sock;
-					break;
-				}
+			continue;
+		}
+
+		/* non-blocking connect will return immediately */
+		fcntl (sock, F_SETFL, O_NONBLOCK);
+		connect (sock, gacurr->ai_addr, gacurr->ai_addrlen);
+
+		sockets[count].fd = sock;
+		sockets[count].events = POLLOUT;
+		++count;
+	}
+
+	while (count > 0 && winner == -1) {
+		int pollres;
+
+		do {
+			errno = 0;
+			pollres = poll (sockets, count, waith->timeout);
+		} while (errno == EINTR || errno == EINPROGRESS || errno == EAGAIN);
+
+		if (pollres == 0) {
+			ret = WAITRESS_RET_TIMEOUT;
+			break;
+		} else if (pollres == -1) {
+			ret = WAITRESS_RET_ERR;
+			break;
+		}
+
+		for (nfds_t i = 0; i < count; i++) {
+			int sockerr;
+			socklen_t sockerrSize = sizeof (sockerr);
+
+			if (sockets[i].revents == 0) {
+				continue;
+			}
+
+			/* check connect () return value */
+			getsockopt (sockets[i].fd, SOL_SOCKET, SO_ERROR, &sockerr,
+					&sockerrSize);
+			if (sockerr == 0) {
+				/* this one is working */
+				winner = sockets[i].fd;
+				break;
 			}
-			close (sock);
+
+			/* connect failed, drop the socket and keep racing the rest */
+			ret = WAITRESS_RET_CONNECT_REFUSED;
+			close (sockets[i].fd);
+			sockets[i] = sockets[count - 1];
+			--count;
+			--i;
+		}
+	}
+
+	/* close the losers */
+	for (nfds_t i = 0; i < count; i++) {
+		if (sockets[i].fd != winner) {
+			close (sockets[i].fd);
 		}
 	}
 
-	freeaddrinfo (gares);
+	if (winner == -1) {
+		return ret;
+	}
+
+	waith->request.sockfd = winner;
+	return WAITRESS_RET_OK;
+}
+
+/*	Connect to server
+ */
+static WaitressReturn_t WaitressConnect (WaitressHandle_t *waith) {
+	WaitressReturn_t ret;
+	struct addrinfo *gares;
+	bool fromCache;
+	WaitressConnection_t * const conn = WaitressActiveConnection (waith);
+	/* connect to the proxy instead of the destination if one is set up */
+	const WaitressUrl_t * const connectUrl = WaitressProxyEnabled (waith) ?
+			&waith->proxy : &waith->url;
+	const char * const connectPort = WaitressProxyEnabled (waith) ?
+			WaitressDefaultPort (&waith->proxy) :
+			WaitressDefaultPort (&waith->url);
+
+	if ((ret = WaitressResolve (waith, connectUrl->host, connectPort,
+			&gares, &fromCache)) != WAITRESS_RET_OK) {
+		return ret;
+	}
+
+	ret = WaitressConnectRace (waith, gares);
+	if (ret != WAITRESS_RET_OK && fromCache) {
+		/* cached addresses may have gone stale, retry with a fresh
+		 * lookup */
+		WaitressDnsInvalidate (waith);
+		if ((ret = WaitressResolve (waith, connectUrl->host, connectPort,
+				&gares, &fromCache)) != WAITRESS_RET_OK) {
+			return ret;
+		}
+		ret = WaitressConnectRace (waith, gares);
+	}
 	/* could not connect to any of the addresses */
 	if (ret != WAITRESS_RET_OK) {
 		return ret;
 	}
 
+	/* remember the connection, it can be reused by the next request; on
+	 * error the caller disconnects again */
+	conn->sockfd = waith->request.sockfd;
+	snprintf (conn->host, sizeof (conn->host), "%s", connectUrl->host);
+	snprintf (conn->port, sizeof (conn->port), "%s", connectPort);
+
 	if (waith->url.tls) {
 		WaitressReturn_t wRet;
 
+		if (!waith->tlsCredValid) {
+			gnutls_certificate_allocate_credentials (&waith->tlsCred);
+			waith->tlsCredValid = true;
+		}
+
+		gnutls_init (&conn->tlsSession, GNUTLS_CLIENT);
+		gnutls_set_default_priority (conn->tlsSession);
+
+		if (gnutls_credentials_set (conn->tlsSession,
+				GNUTLS_CRD_CERTIFICATE,
+				waith->tlsCred) != GNUTLS_E_SUCCESS) {
+			/* tlsSessionValid is not set yet, so WaitressDisconnect would
+			 * not deinit the session */
+			gnutls_deinit (conn->tlsSession);
+			return WAITRESS_RET_ERR;
+		}
+		conn->tlsSessionValid = true;
+		waith->request.tlsSession = conn->tlsSession;
+
+		/* set up custom read/write functions */
+		gnutls_transport_set_ptr (conn->tlsSession,
+				(gnutls_transport_ptr_t) waith);
+		gnutls_transport_set_pull_function (conn->tlsSession,
+				WaitressPollRead);
+		gnutls_transport_set_push_function (conn->tlsSession,
+				WaitressPollWrite);
+
+		/* resume the previous tls session if the server closed the
+		 * connection in the meantime, skips most of the handshake */
+		if (conn->tlsResumeData.data != NULL) {
+			gnutls_session_set_data (conn->tlsSession,
+					conn->tlsResumeData.data, conn->tlsResumeData.size);
+		}
+
 		/* set up proxy tunnel */
 		if (WaitressProxyEnabled (waith)) {
 			char buf[256];
@@ -876,10 +1164,21 @@ static WaitressReturn_t WaitressConnect (WaitressHandle_t *waith) {
 			return WAITRESS_RET_TLS_HANDSHAKE_ERR;
 		}
 
-		if ((wRet = WaitressTlsVerify (waith)) != WAITRESS_RET_OK) {
+		/* certificates are not retransmitted on a resumed session; the
+		 * fingerprint was verified when the session data was cached */
+		if (!gnutls_session_is_resumed (waith->request.tlsSession) &&
+				(wRet = WaitressTlsVerify (waith)) != WAITRESS_RET_OK) {
 			return wRet;
 		}
 
+		/* cache session data for later resumption */
+		if (conn->tlsResumeData.data != NULL) {
+			gnutls_free (conn->tlsResumeData.data);
+			conn->tlsResumeData.data = NULL;
+		}
+		gnutls_session_get_data2 (waith->request.tlsSession,
+				&conn->tlsResumeData);
+
 		/* now we can talk encrypted */
 		waith->request.read = WaitressGnutlsRead;
 		waith->request.write = WaitressGnutlsWrite;
@@ -888,6 +1187,38 @@ static WaitressReturn_t WaitressConnect (WaitressHandle_t *waith) {
 	return WAITRESS_RET_OK;
 }
 
+/*	append to the request buffer, writing to the socket only when the buffer
+ *	is full; this way a request that fits into the buffer (the usual case)
+ *	goes out as a single write and thus one tcp segment/tls record
+ *	@param Waitress handle
+ *	@param current buffer fill
+ *	@param data
+ *	@param data size
+ */
+static WaitressReturn_t WaitressBufferedWrite (WaitressHandle_t *waith,
+		size_t * const off, const char *data, size_t size) {
+	char * const buf = waith->request.buf;
+	WaitressReturn_t wRet = WAITRESS_RET_OK;
+
+	while (size > 0) {
+		size_t copy = waith->bufferSize - *off;
+		if (copy == 0) {
+			WRITE_RET (buf, *off);
+			*off = 0;
+			copy = waith->bufferSize;
+		}
+		if (copy > size) {
+			copy = size;
+		}
+		memcpy (&buf[*off], data, copy);
+		*off += copy;
+		data += copy;
+		size -= copy;
+	}
+
+	return WAITRESS_RET_OK;
+}
+
 /*	Write http header/post data to socket
  */
 static WaitressReturn_t WaitressSendRequest (WaitressHandle_t *waith) {
@@ -895,7 +1226,8 @@ static WaitressReturn_t WaitressSendRequest (WaitressHandle_t *waith) {
 	assert (waith->request.buf != NULL);
 
 	const char *path = waith->url.path;
-	char * const buf = waith->request.buf;
+	char scratch[WAITRESS_BUFFER_SIZE];
+	size_t off = 0;
 	WaitressReturn_t wRet = WAITRESS_RET_OK;
 
 	if (waith->url.path == NULL) {
@@ -906,49 +1238,56 @@ static WaitressReturn_t WaitressSendRequest (WaitressHandle_t *waith) {
 		++path;
 	}
 
-	/* send request */
+	/* assemble the whole request (request line, headers and post body) in
+	 * the request buffer, see WaitressBufferedWrite */
 	if (WaitressProxyEnabled (waith) && !waith->url.tls) {
-		snprintf (buf, WAITRESS_BUFFER_SIZE,
+		snprintf (scratch, sizeof (scratch),
 			"%s http://%s:%s/%s HTTP/" WAITRESS_HTTP_VERSION "\r\n"
-			"Host: %s\r\nUser-Agent: " PACKAGE "\r\nConnection: Close\r\n",
+			"Host: %s\r\nUser-Agent: " PACKAGE "\r\nConnection: Keep-Alive\r\n"
+			"Accept-Encoding: gzip, deflate\r\n",
 			(waith->method == WAITRESS_METHOD_GET ? "GET" : "POST"),
 			waith->url.host,
 			WaitressDefaultPort (&waith->url), path, waith->url.host);
 	} else {
-		snprintf (buf, WAITRESS_BUFFER_SIZE,
+		snprintf (scratch, sizeof (scratch),
 			"%s /%s HTTP/" WAITRESS_HTTP_VERSION "\r\n"
-			"Host: %s\r\nUser-Agent: " PACKAGE "\r\nConnection: Close\r\n",
+			"Host: %s\r\nUser-Agent: " PACKAGE "\r\nConnection: Keep-Alive\r\n"
+			"Accept-Encoding: gzip, deflate\r\n",
 			(waith->method == WAITRESS_METHOD_GET ? "GET" : "POST"),
 			path, waith->url.host);
 	}
-	WRITE_RET (buf, strlen (buf));
+	APPEND_RET (scratch, strlen (scratch));
 
 	if (waith->method == WAITRESS_METHOD_POST && waith->postData != NULL) {
-		snprintf (buf, WAITRESS_BUFFER_SIZE, "Content-Length: %zu\r\n",
+		snprintf (scratch, sizeof (scratch), "Content-Length: %zu\r\n",
 				strlen (waith->postData));
-		WRITE_RET (buf, strlen (buf));
+		APPEND_RET (scratch, strlen (scratch));
 	}
 
 	/* write authorization headers */
-	if (WaitressFormatAuthorization (waith, &waith->url, "", buf,
-			WAITRESS_BUFFER_SIZE)) {
-		WRITE_RET (buf, strlen (buf));
+	if (WaitressFormatAuthorization (waith, &waith->url, "", scratch,
+			sizeof (scratch))) {
+		APPEND_RET (scratch, strlen (scratch));
 	}
 	/* don't leak proxy credentials to destination server if tls is used */
 	if (!waith->url.tls &&
 			WaitressFormatAuthorization (waith, &waith->proxy, "Proxy-",
-			buf, WAITRESS_BUFFER_SIZE)) {
-		WRITE_RET (buf, strlen (buf));
+			scratch, sizeof (scratch))) {
+		APPEND_RET (scratch, strlen (scratch));
 	}
-	
+
 	if (waith->extraHeaders != NULL) {
-		WRITE_RET (waith->extraHeaders, strlen (waith->extraHeaders));
+		APPEND_RET (waith->extraHeaders, strlen (waith->extraHeaders));
 	}
-	
-	WRITE_RET ("\r\n", 2);
+
+	APPEND_RET ("\r\n", 2);
 
 	if (waith->method == WAITRESS_METHOD_POST && waith->postData != NULL) {
-		WRITE_RET (waith->postData, strlen (waith->postData));
+		APPEND_RET (waith->postData, strlen (waith->postData));
+	}
+
+	if (off > 0) {
+		WRITE_RET (waith->request.buf, off);
 	}
 
 	return WAITRESS_RET_OK;
@@ -969,7 +1308,7 @@ static WaitressReturn_t WaitressReceiveHeaders (WaitressHandle_t *waith,
 	/* receive answer */
 	nextLine = buf;
 	while (hdrParseMode != HDRM_FINISHED) {
-		READ_RET (buf+bufFilled, WAITRESS_BUFFER_SIZE-1 - bufFilled, &recvSize);
+		READ_RET (buf+bufFilled, waith->bufferSize-1 - bufFilled, &recvSize);
 		if (recvSize == 0) {
 			/* connection closed too early */
 			return WAITRESS_RET_CONNECTION_CLOSED;
@@ -1046,6 +1385,18 @@ static WaitressReturn_t WaitressReceiveHeaders (WaitressHandle_t *waith,
 	return wRet;
 }
 
+/*	a gzip-encoded body must end with the end of the compressed stream; a
+ *	body that stops short of it was truncated and must not be passed off as
+ *	a successful response
+ */
+static WaitressReturn_t WaitressBodyComplete (const WaitressHandle_t *waith) {
+	if (waith->request.contentEncodingGzip && waith->request.gzipInitialized &&
+			!waith->request.gzipStreamEnd) {
+		return WAITRESS_RET_DECODING_ERR;
+	}
+	return WAITRESS_RET_OK;
+}
+
 /*	read response header and data
  */
 static WaitressReturn_t WaitressReceiveResponse (WaitressHandle_t *waith) {
@@ -1065,7 +1416,9 @@ static WaitressReturn_t WaitressReceiveResponse (WaitressHandle_t *waith) {
 		buf[recvSize] = '\0';
 		switch (waith->request.dataHandler (waith, buf, recvSize)) {
 			case WAITRESS_HANDLER_DONE:
-				return WAITRESS_RET_OK;
+				/* message boundary is known, connection is reusable */
+				waith->request.keepAlive = !waith->request.connectionClose;
+				return WaitressBodyComplete (waith);
 				break;
 
 			case WAITRESS_HANDLER_ERR:
@@ -1084,12 +1437,39 @@ static WaitressReturn_t WaitressReceiveResponse (WaitressHandle_t *waith) {
 				waith->request.contentReceived >= waith->request.contentLength) {
 			/* don’t call read() again if we know the body’s size and have all
 			 * of it already */
+			waith->request.keepAlive = !waith->request.connectionClose;
 			break;
 		}
-		READ_RET (buf, WAITRESS_BUFFER_SIZE-1, &recvSize);
+		READ_RET (buf, waith->bufferSize-1, &recvSize);
 	} while (recvSize > 0);
 
-	return WAITRESS_RET_OK;
+	return WaitressBodyComplete (waith);
+}
+
+/*	check whether the persistent connection matches the current url and the
+ *	server has not closed it in the meantime
+ */
+static bool WaitressConnectionUsable (const WaitressHandle_t *waith,
+		const WaitressConnection_t * const conn) {
+	const WaitressUrl_t * const connectUrl = WaitressProxyEnabled (waith) ?
+			&waith->proxy : &waith->url;
+	const char * const connectPort = WaitressProxyEnabled (waith) ?
+			WaitressDefaultPort (&waith->proxy) :
+			WaitressDefaultPort (&waith->url);
+
+	if (conn->sockfd == -1 || strcmp (conn->host, connectUrl->host) != 0 ||
+			strcmp (conn->port, connectPort) != 0) {
+		return false;
+	}
+
+	/* an idle keep-alive connection must not have pending input; readable
+	 * data (or eof) means the server closed it */
+	struct pollfd probe = {conn->sockfd, POLLIN, 0};
+	if (poll (&probe, 1, 0) != 0) {
+		return false;
+	}
+
+	return true;
 }
 
 /*	Receive data from host and call *callback ()
@@ -1098,63 +1478,128 @@ static WaitressReturn_t WaitressReceiveResponse (WaitressHandle_t *waith) {
  */
 WaitressReturn_t WaitressFetchCall (WaitressHandle_t *waith) {
 	WaitressReturn_t wRet = WAITRESS_RET_OK;
+	WaitressConnection_t * const conn = WaitressActiveConnection (waith);
+
+	/* reuse the persistent connection; if the server closed it in the
+	 * meantime the request is retried once on a fresh connection */
+	for (unsigned int attempt = 0; attempt < 2; attempt++) {
+		const bool reusing = WaitressConnectionUsable (waith, conn);
+
+		/* initialize */
+		memset (&waith->request, 0, sizeof (waith->request));
+		waith->request.sockfd = -1;
+		waith->request.dataHandler = WaitressHandleIdentity;
+		waith->request.read = WaitressOrdinaryRead;
+		waith->request.write = WaitressOrdinaryWrite;
+		waith->request.contentLengthKnown = false;
+
+		/* buffer is required for connect already */
+		waith->request.buf = malloc (waith->bufferSize *
+				sizeof (*waith->request.buf));
+
+		/* request */
+		if (reusing) {
+			waith->request.sockfd = conn->sockfd;
+			if (waith->url.tls) {
+				waith->request.tlsSession = conn->tlsSession;
+				waith->request.read = WaitressGnutlsRead;
+				waith->request.write = WaitressGnutlsWrite;
+			}
+			wRet = WAITRESS_RET_OK;
+		} else {
+			WaitressDisconnect (conn);
+			wRet = WaitressConnect (waith);
+		}
 
-	/* initialize */
-	memset (&waith->request, 0, sizeof (waith->request));
-	waith->request.sockfd = -1;
-	waith->request.dataHandler = WaitressHandleIdentity;
-	waith->request.read = WaitressOrdinaryRead;
-	waith->request.write = WaitressOrdinaryWrite;
-	waith->request.contentLengthKnown = false;
-
-	if (waith->url.tls) {
-		gnutls_init (&waith->request.tlsSession, GNUTLS_CLIENT);
-		gnutls_set_default_priority (waith->request.tlsSession);
+		if (wRet == WAITRESS_RET_OK) {
+			if ((wRet = WaitressSendRequest (waith)) == WAITRESS_RET_OK) {
+				wRet = WaitressReceiveResponse (waith);
+			}
+		}
 
-		gnutls_certificate_allocate_credentials (&waith->tlsCred);
-		if (gnutls_credentials_set (waith->request.tlsSession,
-				GNUTLS_CRD_CERTIFICATE,
-				waith->tlsCred) != GNUTLS_E_SUCCESS) {
-			return WAITRESS_RET_ERR;
+		/* cleanup */
+		if (wRet == WAITRESS_RET_OK && waith->request.keepAlive) {
+			/* connection stays open for the next request */
+		} else {
+			if (waith->url.tls && conn->tlsSessionValid &&
+					wRet == WAITRESS_RET_OK) {
+				gnutls_bye (conn->tlsSession, GNUTLS_SHUT_RDWR);
+			}
+			WaitressDisconnect (conn);
+		}
+		if (waith->request.gzipInitialized) {
+			inflateEnd (&waith->request.gzipStream);
+			waith->request.gzipInitialized = false;
+		}
+		free (waith->request.buf);
+		waith->request.buf = NULL;
+
+		if (reusing && waith->request.contentReceived == 0 &&
+				(wRet == WAITRESS_RET_CONNECTION_CLOSED ||
+				wRet == WAITRESS_RET_READ_ERR ||
+				wRet == WAITRESS_RET_TLS_READ_ERR ||
+				wRet == WAITRESS_RET_TLS_WRITE_ERR ||
+				wRet == WAITRESS_RET_ERR)) {
+			/* stale keep-alive connection; retrying is only safe while the
+			 * callback has not consumed any of the first response yet,
+			 * otherwise the repeated response corrupts its state */
+			continue;
 		}
+		break;
+	}
 
-		/* set up custom read/write functions */
-		gnutls_transport_set_ptr (waith->request.tlsSession,
-				(gnutls_transport_ptr_t) waith);
-		gnutls_transport_set_pull_function (waith->request.tlsSession,
-				WaitressPollRead);
-		gnutls_transport_set_push_function (waith->request.tlsSession,
-				WaitressPollWrite);
+	if (wRet == WAITRESS_RET_OK &&
+			waith->request.contentReceived < waith->request.contentLength) {
+		return WAITRESS_RET_PARTIAL_FILE;
 	}
+	return wRet;
+}
 
-	/* buffer is required for connect already */
-	waith->request.buf = malloc (WAITRESS_BUFFER_SIZE *
-			sizeof (*waith->request.buf));
+/*	thread wrapper for WaitressFetchCall, see WaitressMultiFetchCall
+ */
+static void *WaitressMultiFetchThread (void *data) {
+	WaitressMulti_t * const multi = data;
 
-	/* request */
-	if ((wRet = WaitressConnect (waith)) == WAITRESS_RET_OK) {
-		if ((wRet = WaitressSendRequest (waith)) == WAITRESS_RET_OK) {
-			wRet = WaitressReceiveResponse (waith);
-		}
-		if (waith->url.tls) {
-			gnutls_bye (waith->request.tlsSession, GNUTLS_SHUT_RDWR);
+	multi->ret = WaitressFetchCall (multi->waith);
+
+	return NULL;
+}
+
+/*	Run several fetches concurrently and wait for all of them; every entry
+ *	needs its own handle with url and callback set up. Results are stored
+ *	in each entry's ret.
+ *	@param request array
+ *	@param number of requests
+ *	@return WAITRESS_RET_OK if all requests succeeded, otherwise the first
+ *			entry's error
+ */
+WaitressReturn_t WaitressMultiFetchCall (WaitressMulti_t *requests,
+		size_t count) {
+	assert (requests != NULL);
+
+	WaitressReturn_t wRet = WAITRESS_RET_OK;
+
+	for (size_t i = 0; i < count; i++) {
+		assert (requests[i].waith != NULL);
+		requests[i].ret = WAITRESS_RET_ERR;
+		if (pthread_create (&requests[i].thread, NULL,
+				WaitressMultiFetchThread, &requests[i]) != 0) {
+			/* run in place, the remaining requests lose their overlap but
+			 * none of them is dropped */
+			WaitressMultiFetchThread (&requests[i]);
+			requests[i].thread = pthread_self ();
 		}
 	}
 
-	/* cleanup */
-	if (waith->url.tls) {
-		gnutls_deinit (waith->request.tlsSession);
-		gnutls_certificate_free_credentials (waith->tlsCred);
-	}
-	if (waith->request.sockfd != -1) {
-		close (waith->request.sockfd);
+	for (size_t i = 0; i < count; i++) {
+		if (!pthread_equal (requests[i].thread, pthread_self ())) {
+			pthread_join (requests[i].thread, NULL);
+		}
+		if (wRet == WAITRESS_RET_OK) {
+			wRet = requests[i].ret;
+		}
 	}
-	free (waith->request.buf);
 
-	if (wRet == WAITRESS_RET_OK &&
-			waith->request.contentReceived < waith->request.contentLength) {
-		return WAITRESS_RET_PARTIAL_FILE;
-	}
 	return wRet;
 }
 
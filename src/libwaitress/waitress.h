@@ -27,7 +27,11 @@ THE SOFTWARE.
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
 #include <gnutls/gnutls.h>
+#include <zlib.h>
 
 #define WAITRESS_BUFFER_SIZE 10*1024
 
@@ -84,10 +88,31 @@ typedef enum {
 	WAITRESS_RET_TLS_FINGERPRINT_MISMATCH,
 } WaitressReturn_t;
 
+/*	persistent connection, kept open across requests (http keep-alive)
+ */
+typedef struct {
+	/* -1 if disconnected */
+	int sockfd;
+
+	gnutls_session_t tlsSession;
+	bool tlsSessionValid;
+	/* cached session data for tls session resumption after the server
+	 * closed the connection */
+	gnutls_datum_t tlsResumeData;
+
+	/* host/port actually connected to (server or proxy) */
+	char host[256];
+	char port[16];
+} WaitressConnection_t;
+
 /*	reusable handle
  */
 typedef struct {
 	int timeout;
+	/* size of the receive/request buffer in bytes, defaults to
+	 * WAITRESS_BUFFER_SIZE; raise it for large transfers (audio files) so a
+	 * single read can drain more data per syscall */
+	size_t bufferSize;
 	WaitressMethod_t method;
 
 	const char *extraHeaders;
@@ -101,6 +126,18 @@ typedef struct {
 	WaitressUrl_t proxy;
 
 	gnutls_certificate_credentials_t tlsCred;
+	bool tlsCredValid;
+
+	/* positive dns cache for the connect host, see WaitressResolve;
+	 * getaddrinfo does not expose record ttls, so entries expire after a
+	 * fixed lifetime and are dropped early if connecting to them fails */
+	struct addrinfo *dnsCache;
+	char dnsCacheHost[256];
+	char dnsCachePort[16];
+	time_t dnsCacheExpires;
+
+	/* connection pool, one plain http and one tls connection */
+	WaitressConnection_t conn[2];
 
 	/* per-request data */
 	struct {
@@ -113,6 +150,21 @@ typedef struct {
 		bool contentLengthKnown;
 		enum {CHUNKSIZE = 0, DATA = 1} chunkedState;
 
+		/* server sent "Content-Encoding: gzip" (or deflate), body is
+		 * decompressed transparently before it reaches the callback */
+		bool contentEncodingGzip;
+		bool gzipInitialized;
+		/* inflate saw the end of the compressed stream; if the body ends
+		 * without it the response was truncated */
+		bool gzipStreamEnd;
+		z_stream gzipStream;
+
+		/* server sent "Connection: close" */
+		bool connectionClose;
+		/* response ended at a known message boundary, connection is
+		 * reusable */
+		bool keepAlive;
+
 		char *buf;
 		/* first argument is WaitressHandle_t, but that's not defined yet */
 		WaitressHandlerReturn_t (*dataHandler) (void *, char *, const size_t);
@@ -123,6 +175,17 @@ typedef struct {
 	} request;
 } WaitressHandle_t;
 
+/*	one entry of a concurrent fetch, see WaitressMultiFetchCall
+ */
+typedef struct {
+	/* handle to run, with url and callback set up */
+	WaitressHandle_t *waith;
+	/* result of this entry's fetch */
+	WaitressReturn_t ret;
+	/* internal */
+	pthread_t thread;
+} WaitressMulti_t;
+
 void WaitressInit (WaitressHandle_t *);
 void WaitressFree (WaitressHandle_t *);
 bool WaitressSetProxy (WaitressHandle_t *, const char *);
@@ -130,6 +193,7 @@ char *WaitressUrlEncode (const char *);
 bool WaitressSetUrl (WaitressHandle_t *, const char *);
 WaitressReturn_t WaitressFetchBuf (WaitressHandle_t *, char **);
 WaitressReturn_t WaitressFetchCall (WaitressHandle_t *);
+WaitressReturn_t WaitressMultiFetchCall (WaitressMulti_t *, size_t);
 const char *WaitressErrorToStr (WaitressReturn_t);
 
 #endif /* SRC_LIBWAITRESS_WAITRESS_H_ZE5NT8JI */
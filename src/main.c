@@ -60,6 +60,8 @@ THE SOFTWARE.
 #include "ui.h"
 #include "ui_dispatch.h"
 #include "ui_readline.h"
+#include "recorder.h"
+#include "stats.h"
 
 /*	copy proxy settings to waitress handle
  */
@@ -223,12 +225,85 @@ static bool BarMainGetStations (BarApp_t *app) {
 	return ret;
 }
 
+/*	wake the main loop's input poll, called by worker threads when they are
+ *	done
+ */
+static void BarMainWakeLoop (BarApp_t *app) {
+	if (app->eventPipe[1] != -1) {
+		write (app->eventPipe[1], "", 1);
+	}
+}
+
+/*	refresh station list in the background while the ui runs from the cached
+ *	copy, see BarMainLoadStations
+ */
+static void *BarMainStationRefreshThread (void *data) {
+	BarApp_t *app = data;
+
+	BarMainGetStations (app);
+	app->stationRefreshDone = true;
+	BarMainWakeLoop (app);
+
+	return NULL;
+}
+
+/*	pick up the station list fetched by the refresh thread: re-resolve the
+ *	current station into the fresh list and update the on-disk cache. the
+ *	cached list itself is kept around until the player does not reference it
+ *	anymore, see BarMainPlayerCleanup
+ */
+static void BarMainFinishStationRefresh (BarApp_t *app) {
+	pthread_join (app->stationRefreshThread, NULL);
+	app->stationRefreshRunning = false;
+	app->stationRefreshDone = false;
+	app->stationsRefreshed = true;
+
+	if (app->curStation != NULL && app->ph.stations != NULL) {
+		PianoStation_t * const fresh = PianoFindStationById (app->ph.stations,
+				app->curStation->id);
+		if (fresh != NULL) {
+			app->curStation = fresh;
+		}
+	}
+
+	if (app->ph.stations != NULL) {
+		BarStationCacheWrite (app->ph.stations);
+	}
+}
+
+/*	load station list: use the on-disk cache if there is one, so the ui is
+ *	usable right away, and refresh from the network in the background;
+ *	otherwise block on the network like before
+ */
+static bool BarMainLoadStations (BarApp_t *app) {
+	app->cachedStations = BarStationCacheRead ();
+	if (app->cachedStations != NULL) {
+		BarUiMsg (&app->settings, MSG_INFO, "Using cached station list.\n");
+		if (pthread_create (&app->stationRefreshThread, NULL,
+				BarMainStationRefreshThread, app) == 0) {
+			app->stationRefreshRunning = true;
+		}
+		return true;
+	}
+
+	if (!BarMainGetStations (app)) {
+		return false;
+	}
+	app->stationsRefreshed = true;
+	BarStationCacheWrite (app->ph.stations);
+
+	return true;
+}
+
 /*	get initial station from autostart setting or user input
  */
 static void BarMainGetInitialStation (BarApp_t *app) {
+	/* the fresh list may still be in flight, fall back to the cache */
+	PianoStation_t * const stations = BarUiStations (app);
+
 	/* try to get autostart station */
 	if (app->settings.autostartStation != NULL) {
-		app->curStation = PianoFindStationById (app->ph.stations,
+		app->curStation = PianoFindStationById (stations,
 				app->settings.autostartStation);
 		if (app->curStation == NULL) {
 			BarUiMsg (&app->settings, MSG_ERR,
@@ -237,7 +312,7 @@ static void BarMainGetInitialStation (BarApp_t *app) {
 	}
 	/* no autostart? ask the user */
 	if (app->curStation == NULL) {
-		app->curStation = BarUiSelectStation (app, app->ph.stations,
+		app->curStation = BarUiSelectStation (app, stations,
 				"Select station: ", NULL, app->settings.autoselect);
 	}
 	if (app->curStation != NULL) {
@@ -249,27 +324,203 @@ static void BarMainGetInitialStation (BarApp_t *app) {
  */
 static void BarMainHandleUserInput (BarApp_t *app) {
 	char buf[2];
+	int timeout = 1;
+
+	/* while nothing is playing there is no time display to update; sleep
+	 * until the user or a worker thread (through the event pipe) wakes us.
+	 * with a station still selected a playlist fetch must have failed, keep
+	 * the tick so the main loop retries it */
+	if ((app->player.mode == PLAYER_DEAD && app->curStation == NULL) ||
+			app->player.doPause) {
+		timeout = -1;
+	}
+
 	if (BarReadline (buf, sizeof (buf), NULL, &app->input,
-			BAR_RL_FULLRETURN | BAR_RL_NOECHO, 1) > 0) {
+			BAR_RL_FULLRETURN | BAR_RL_NOECHO | BAR_RL_EVENTS, timeout) > 0) {
 		BarUiDispatch (app, buf[0], app->curStation, app->playlist, true,
 				BAR_DC_GLOBAL);
 	}
 }
 
+/*	fetch playlist for the station the prefetch was started for, result is
+ *	picked up by BarMainGetPlaylist
+ */
+static void *BarMainPrefetchThread (void *data) {
+	BarApp_t *app = data;
+	PianoReturn_t pRet;
+	WaitressReturn_t wRet;
+	PianoRequestDataGetPlaylist_t reqData;
+	/* private station copy, the request only needs the id; the real station
+	 * may be deleted by the main thread while we wait for pianoMutex (see
+	 * recorder.c, which does the same) */
+	PianoStation_t station;
+	memset (&station, 0, sizeof (station));
+	station.id = app->prefetchStationId;
+	reqData.station = &station;
+	reqData.quality = app->audioQuality;
+
+	BarUiMsg (&app->settings, MSG_INFO, "Prefetching new playlist... ");
+	if (BarUiPianoCall (app, PIANO_REQUEST_GET_PLAYLIST, &reqData, &pRet,
+			&wRet)) {
+		app->prefetchPlaylist = reqData.retPlaylist;
+	}
+	BarMainWakeLoop (app);
+
+	return NULL;
+}
+
+/*	fire playlist request on a background thread as soon as the queue drops
+ *	to the last remaining song, avoids blocking the main loop between songs
+ */
+static void BarMainPrefetchPlaylist (BarApp_t *app) {
+	if (app->player.mode != PLAYER_PLAYING || app->curStation == NULL ||
+			app->prefetchRunning || app->prefetchPlaylist != NULL) {
+		return;
+	}
+	/* wait until the current song is the only one left */
+	if (app->playlist == NULL || PianoListNextP (app->playlist) != NULL) {
+		return;
+	}
+
+	free (app->prefetchStationId);
+	if ((app->prefetchStationId = strdup (app->curStation->id)) == NULL) {
+		return;
+	}
+	if (pthread_create (&app->prefetchThread, NULL, BarMainPrefetchThread,
+			app) == 0) {
+		app->prefetchRunning = true;
+	}
+}
+
+/*	write callback for the precache download
+ */
+static WaitressCbReturn_t BarMainPrecacheCb (void *ptr, size_t size,
+		void *data) {
+	BarApp_t *app = data;
+
+	if (app->precacheAbort) {
+		return WAITRESS_CB_RET_ERR;
+	}
+	if (fwrite (ptr, 1, size, app->precacheFd) != size) {
+		return WAITRESS_CB_RET_ERR;
+	}
+
+	return WAITRESS_CB_RET_OK;
+}
+
+/*	download the stream precacheUrl points at into the current precache
+ *	slot
+ */
+static void *BarMainPrecacheThread (void *data) {
+	BarApp_t *app = data;
+	WaitressReturn_t wRet = WAITRESS_RET_ERR;
+	const char * const path = app->precacheFile[app->precacheSlot];
+
+	app->precacheFd = fopen (path, "w");
+	if (app->precacheFd != NULL &&
+			WaitressSetUrl (&app->precacheWaith, app->precacheUrl)) {
+		app->precacheWaith.data = app;
+		app->precacheWaith.callback = BarMainPrecacheCb;
+		app->precacheWaith.method = WAITRESS_METHOD_GET;
+		wRet = WaitressFetchCall (&app->precacheWaith);
+	}
+	if (app->precacheFd != NULL) {
+		fclose (app->precacheFd);
+		app->precacheFd = NULL;
+	}
+
+	app->precacheComplete = wRet == WAITRESS_RET_OK;
+	app->precacheDone = true;
+	BarMainWakeLoop (app);
+
+	return NULL;
+}
+
+/*	download the next queued song into a local file while the current one
+ *	plays, so the next player thread starts without touching the network
+ */
+static void BarMainPrecacheNext (BarApp_t *app) {
+	static const char httpPrefix[] = "http://";
+
+	if (app->player.mode != PLAYER_PLAYING || app->precacheRunning) {
+		return;
+	}
+	/* disabled because the temp files could not be created */
+	if (app->precacheFile[0][0] == '\0' || app->precacheFile[1][0] == '\0') {
+		return;
+	}
+
+	PianoSong_t * const next = app->playlist != NULL ?
+			PianoListNextP (app->playlist) : NULL;
+	if (next == NULL || next->audioUrl == NULL ||
+			strncmp (next->audioUrl, httpPrefix,
+			strlen (httpPrefix)) != 0) {
+		return;
+	}
+	if (app->precacheUrl != NULL &&
+			strcmp (app->precacheUrl, next->audioUrl) == 0) {
+		/* already downloaded (or the download just failed, don't retry) */
+		return;
+	}
+
+	free (app->precacheUrl);
+	app->precacheUrl = strdup (next->audioUrl);
+	app->precacheComplete = false;
+	app->precacheDone = false;
+	app->precacheAbort = false;
+	/* the other slot may still be played back right now */
+	app->precacheSlot ^= 1;
+	if (pthread_create (&app->precacheThread, NULL, BarMainPrecacheThread,
+			app) == 0) {
+		app->precacheRunning = true;
+	}
+}
+
 /*	fetch new playlist
  */
 static void BarMainGetPlaylist (BarApp_t *app) {
 	PianoReturn_t pRet;
 	WaitressReturn_t wRet;
 	PianoRequestDataGetPlaylist_t reqData;
+
+	/* pick up prefetched playlist if there is one */
+	if (app->prefetchRunning) {
+		pthread_join (app->prefetchThread, NULL);
+		app->prefetchRunning = false;
+	}
+	if (app->prefetchPlaylist != NULL) {
+		/* compare by id: the prefetched station may have been deleted (and
+		 * its memory reused) in the meantime */
+		if (app->prefetchStationId != NULL && app->curStation != NULL &&
+				strcmp (app->prefetchStationId, app->curStation->id) == 0) {
+			app->playlist = app->prefetchPlaylist;
+			app->prefetchPlaylist = NULL;
+			BarUiStartEventCmd (&app->settings, "stationfetchplaylist",
+					app->curStation, app->playlist, &app->player,
+					BarUiStations (app), PIANO_RET_OK, WAITRESS_RET_OK);
+			return;
+		} else {
+			/* user switched stations while the request was in flight */
+			PianoDestroyPlaylist (app->prefetchPlaylist);
+			app->prefetchPlaylist = NULL;
+		}
+	}
+
 	reqData.station = app->curStation;
-	reqData.quality = app->settings.audioQuality;
+	reqData.quality = app->audioQuality;
 
 	BarUiMsg (&app->settings, MSG_INFO, "Receiving new playlist... ");
 	if (!BarUiPianoCall (app, PIANO_REQUEST_GET_PLAYLIST,
 			&reqData, &pRet, &wRet)) {
-		app->curStation = NULL;
+		if (wRet != WAITRESS_RET_OK &&
+				++app->playerErrors < app->settings.maxPlayerErrors) {
+			/* transient network error: keep the station, the main loop's
+			 * tick retries the fetch (see BarMainHandleUserInput) */
+		} else {
+			app->curStation = NULL;
+		}
 	} else {
+		app->playerErrors = 0;
 		app->playlist = reqData.retPlaylist;
 		if (app->playlist == NULL) {
 			BarUiMsg (&app->settings, MSG_INFO, "No tracks left.\n");
@@ -277,7 +528,7 @@ static void BarMainGetPlaylist (BarApp_t *app) {
 		}
 	}
 	BarUiStartEventCmd (&app->settings, "stationfetchplaylist",
-			app->curStation, app->playlist, &app->player, app->ph.stations,
+			app->curStation, app->playlist, &app->player, BarUiStations (app),
 			pRet, wRet);
 }
 
@@ -291,7 +542,7 @@ static void BarMainStartPlayback (BarApp_t *app, pthread_t *playerThread) {
 	assert (curSong != NULL);
 
 	BarUiPrintSong (&app->settings, curSong, app->curStation->isQuickMix ?
-			PianoFindStationById (app->ph.stations,
+			PianoFindStationById (BarUiStations (app),
 			curSong->stationId) : NULL);
 
 	static const char httpPrefix[] = "http://";
@@ -304,18 +555,30 @@ static void BarMainStartPlayback (BarApp_t *app, pthread_t *playerThread) {
 		memset (&app->player, 0, sizeof (app->player));
 
 		app->player.url = curSong->audioUrl;
+		if (app->precacheRunning && app->precacheUrl != NULL &&
+				strcmp (app->precacheUrl, curSong->audioUrl) == 0) {
+			/* still downloading the song we are about to stream anyway,
+			 * don't fetch it twice */
+			app->precacheAbort = true;
+		} else if (!app->precacheRunning && app->precacheComplete &&
+				app->precacheUrl != NULL &&
+				strcmp (app->precacheUrl, curSong->audioUrl) == 0) {
+			/* precached during the previous song, play the local copy */
+			app->player.url = app->precacheFile[app->precacheSlot];
+		}
 		app->player.artist = curSong->artist;
 		app->player.title = curSong->title;
 		app->player.station = app->curStation->name;
 		app->player.gain = curSong->fileGain;
 		app->player.settings = &app->settings;
 		app->player.songDuration = curSong->length;
+		app->player.eventFd = app->eventPipe[1];
 		pthread_mutex_init (&app->player.pauseMutex, NULL);
 		pthread_cond_init (&app->player.pauseCond, NULL);
 
 		/* throw event */
 		BarUiStartEventCmd (&app->settings, "songstart",
-				app->curStation, curSong, &app->player, app->ph.stations,
+				app->curStation, curSong, &app->player, BarUiStations (app),
 				PIANO_RET_OK, WAITRESS_RET_OK);
 
 		/* prevent race condition, mode must _not_ be DEAD if
@@ -327,13 +590,56 @@ static void BarMainStartPlayback (BarApp_t *app, pthread_t *playerThread) {
 	}
 }
 
+/*	adjust the quality tier for upcoming playlists from the just-played
+ *	song's network statistics: drop a tier when the stream stalled or the
+ *	link could not keep up with the stream's bitrate, go back up (bounded by
+ *	settings.audioQuality) after a few clean songs with plenty of headroom
+ */
+static void BarMainAdaptQuality (BarApp_t *app) {
+	/* approximate stream bitrates (kbit/s) per quality tier */
+	static const unsigned int qualityKbps[] = {0, 32, 64, 192};
+	static const char *qualityName[] = {"", "low", "medium", "high"};
+	const player_t * const player = &app->player;
+
+	if (!app->settings.adaptiveQuality || player->readTime <= 0) {
+		return;
+	}
+
+	/* average network read rate; reads are timed inside av_read_frame, so
+	 * decode/playback pacing does not dilute the measurement */
+	const unsigned int throughputKbps = (uint64_t) player->bytesReceived *
+			8000 / player->readTime;
+
+	if (player->readStalls >= 2 ||
+			throughputKbps < qualityKbps[app->audioQuality]) {
+		app->cleanSongs = 0;
+		if (app->audioQuality > PIANO_AQ_LOW) {
+			--app->audioQuality;
+			BarUiMsg (&app->settings, MSG_INFO, "Network is slow, "
+					"switching to %s quality.\n",
+					qualityName[app->audioQuality]);
+		}
+	} else {
+		++app->cleanSongs;
+		if (app->cleanSongs >= 3 &&
+				app->audioQuality < app->settings.audioQuality &&
+				throughputKbps >= 2 * qualityKbps[app->audioQuality + 1]) {
+			++app->audioQuality;
+			app->cleanSongs = 0;
+			BarUiMsg (&app->settings, MSG_INFO, "Network has recovered, "
+					"switching to %s quality.\n",
+					qualityName[app->audioQuality]);
+		}
+	}
+}
+
 /*	player is done, clean up
  */
 static void BarMainPlayerCleanup (BarApp_t *app, pthread_t *playerThread) {
 	void *threadRet;
 
 	BarUiStartEventCmd (&app->settings, "songfinish", app->curStation,
-			app->playlist, &app->player, app->ph.stations, PIANO_RET_OK,
+			app->playlist, &app->player, BarUiStations (app), PIANO_RET_OK,
 			WAITRESS_RET_OK);
 
 	/* FIXME: pthread_join blocks everything if network connection
@@ -354,7 +660,33 @@ static void BarMainPlayerCleanup (BarApp_t *app, pthread_t *playerThread) {
 		app->curStation = NULL;
 	}
 
+	BarStatsAddSong (&app->player);
+
+	/* local (precached) playback says nothing about the link */
+	if (app->player.url != NULL &&
+			strncmp (app->player.url, "http://", 7) == 0) {
+		BarMainAdaptQuality (app);
+	}
+
 	memset (&app->player, 0, sizeof (app->player));
+
+	/* drop the cached station list once the fresh one has arrived and the
+	 * player does not reference it anymore; the current station might still
+	 * be a cached structure if it vanished server-side */
+	if (app->cachedStations != NULL && app->stationsRefreshed) {
+		bool inUse = false;
+		PianoStation_t *curStation = app->cachedStations;
+		PianoListForeachP (curStation) {
+			if (curStation == app->curStation) {
+				inUse = true;
+				break;
+			}
+		}
+		if (!inUse) {
+			PianoDestroyStations (app->cachedStations);
+			app->cachedStations = NULL;
+		}
+	}
 }
 
 /*	print song duration
@@ -394,13 +726,14 @@ static void BarMainLoop (BarApp_t *app) {
 		return;
 	}
 
-	if (!BarMainGetStations (app)) {
+	if (!BarMainLoadStations (app)) {
 		return;
 	}
 
-
 	BarMainGetInitialStation (app);
 
+	BarRecorderStart (app);
+
 	/* little hack, needed to signal: hey! we need a playlist, but don't
 	 * free anything (there is nothing to be freed yet) */
 	memset (&app->player, 0, sizeof (app->player));
@@ -411,6 +744,11 @@ static void BarMainLoop (BarApp_t *app) {
 			BarMainPlayerCleanup (app, &playerThread);
 		}
 
+		/* pick up fresh station list */
+		if (app->stationRefreshRunning && app->stationRefreshDone) {
+			BarMainFinishStationRefresh (app);
+		}
+
 		/* check whether player finished playing and start playing new
 		 * song */
 		if (app->player.mode == PLAYER_DEAD && app->curStation != NULL) {
@@ -430,6 +768,18 @@ static void BarMainLoop (BarApp_t *app) {
 			}
 		}
 
+		/* pick up finished precache download */
+		if (app->precacheRunning && app->precacheDone) {
+			pthread_join (app->precacheThread, NULL);
+			app->precacheRunning = false;
+		}
+
+		/* fetch next playlist while the last song is still playing */
+		BarMainPrefetchPlaylist (app);
+
+		/* download the next song while the current one plays */
+		BarMainPrecacheNext (app);
+
 		BarMainHandleUserInput (app);
 
 		/* show time */
@@ -441,6 +791,19 @@ static void BarMainLoop (BarApp_t *app) {
 	if (app->player.mode != PLAYER_DEAD) {
 		pthread_join (playerThread, NULL);
 	}
+	if (app->prefetchRunning) {
+		pthread_join (app->prefetchThread, NULL);
+		app->prefetchRunning = false;
+	}
+	if (app->precacheRunning) {
+		app->precacheAbort = true;
+		pthread_join (app->precacheThread, NULL);
+		app->precacheRunning = false;
+	}
+	if (app->stationRefreshRunning) {
+		BarMainFinishStationRefresh (app);
+	}
+	BarRecorderStop ();
 }
 
 int main (int argc, char **argv) {
@@ -460,9 +823,11 @@ int main (int argc, char **argv) {
 	gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
 	gnutls_global_init ();
 	BarPlayerInit ();
+	pthread_mutex_init (&app.pianoMutex, NULL);
 
 	BarSettingsInit (&app.settings);
 	BarSettingsRead (&app.settings);
+	app.audioQuality = app.settings.audioQuality;
 
 	PianoReturn_t pret;
 	if ((pret = PianoInit (&app.ph, app.settings.partnerUser,
@@ -484,14 +849,30 @@ int main (int argc, char **argv) {
 	}
 
 	WaitressInit (&app.waith);
+	WaitressInit (&app.precacheWaith);
+	/* precache downloads whole audio files; a bigger buffer means fewer
+	 * read syscalls */
+	app.precacheWaith.bufferSize = 64*1024;
+	for (size_t i = 0; i < sizeof (app.precacheFile) /
+			sizeof (*app.precacheFile); i++) {
+		/* mkstemp: a predictable name in /tmp could be planted as a symlink
+		 * and make the download clobber someone else's file */
+		snprintf (app.precacheFile[i], sizeof (*app.precacheFile),
+				"/tmp/" PACKAGE "-precache-XXXXXX");
+		const int fd = mkstemp (app.precacheFile[i]);
+		if (fd == -1) {
+			/* no temp files, no precaching */
+			app.precacheFile[i][0] = '\0';
+		} else {
+			close (fd);
+		}
+	}
 	app.waith.url.host = app.settings.rpcHost;
 	app.waith.url.tlsPort = app.settings.rpcTlsPort;
 	app.waith.tlsFingerprint = app.settings.tlsFingerprint;
 
 	/* init fds */
-	FD_ZERO(&app.input.set);
 	app.input.fds[0] = STDIN_FILENO;
-	FD_SET(app.input.fds[0], &app.input.set);
 
 	/* open fifo read/write so it won't EOF if nobody writes to it */
 	assert (sizeof (app.input.fds) / sizeof (*app.input.fds) >= 2);
@@ -506,27 +887,56 @@ int main (int argc, char **argv) {
 			close (app.input.fds[1]);
 			app.input.fds[1] = -1;
 		} else {
-			FD_SET(app.input.fds[1], &app.input.set);
 			BarUiMsg (&app.settings, MSG_INFO, "Control fifo at %s opened\n",
 					app.settings.fifo);
 		}
 	}
-	app.input.maxfd = app.input.fds[0] > app.input.fds[1] ? app.input.fds[0] :
-			app.input.fds[1];
-	++app.input.maxfd;
+
+	/* worker threads wake the main loop through this pipe, so it can sleep
+	 * indefinitely while nothing is happening */
+	app.input.eventfd = -1;
+	app.eventPipe[0] = -1;
+	app.eventPipe[1] = -1;
+	if (pipe (app.eventPipe) != -1) {
+		fcntl (app.eventPipe[0], F_SETFL, O_NONBLOCK);
+		fcntl (app.eventPipe[1], F_SETFL, O_NONBLOCK);
+		app.input.eventfd = app.eventPipe[0];
+	}
 
 	BarMainLoop (&app);
 
 	if (app.input.fds[1] != -1) {
 		close (app.input.fds[1]);
 	}
+	if (app.eventPipe[0] != -1) {
+		close (app.eventPipe[0]);
+		close (app.eventPipe[1]);
+	}
 
 	/* write statefile */
 	BarSettingsWrite (app.curStation, &app.settings);
 
-	PianoDestroy (&app.ph);
+	BarUiStopEventCmd ();
+	BarUiDestroyStationIndex ();
+
+	/* playlists hold references into the handle's interning pool, destroy
+	 * them first */
+	PianoDestroyStations (app.cachedStations);
 	PianoDestroyPlaylist (app.songHistory);
+	free (app.songHistoryRing);
 	PianoDestroyPlaylist (app.playlist);
+	PianoDestroyPlaylist (app.prefetchPlaylist);
+	free (app.prefetchStationId);
+	PianoDestroy (&app.ph);
+	pthread_mutex_destroy (&app.pianoMutex);
+	free (app.precacheUrl);
+	for (size_t i = 0; i < sizeof (app.precacheFile) /
+			sizeof (*app.precacheFile); i++) {
+		if (app.precacheFile[i][0] != '\0') {
+			unlink (app.precacheFile[i]);
+		}
+	}
+	WaitressFree (&app.precacheWaith);
 	WaitressFree (&app.waith);
 	BarPlayerDestroy ();
 	gnutls_global_deinit ();
@@ -26,6 +26,9 @@ THE SOFTWARE.
 
 #include <piano.h>
 #include <waitress.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 #include "player.h"
 #include "settings.h"
@@ -39,10 +42,61 @@ typedef struct {
 	/* first item is current song */
 	PianoSong_t *playlist;
 	PianoSong_t *songHistory;
+	/* ring of history slots (newest insert position and fill) for O(1)
+	 * eviction, see BarUiHistoryPrepend */
+	PianoSong_t **songHistoryRing;
+	size_t songHistoryPos, songHistoryLen;
+	/* quality tier requested for new playlists; lowered/raised from the
+	 * measured throughput when settings.adaptiveQuality is set, see
+	 * BarMainAdaptQuality. settings.audioQuality is the upper bound */
+	PianoAudioQuality_t audioQuality;
+	/* songs in a row without network trouble, raise the tier again after a
+	 * few of those */
+	unsigned int cleanSongs;
 	PianoStation_t *curStation;
 	char doQuit;
 	BarReadlineFds_t input;
+	/* worker threads write a byte to wake the main loop's input poll, see
+	 * BarMainHandleUserInput */
+	int eventPipe[2];
 	unsigned int playerErrors;
+	/* serializes piano api requests, see BarUiPianoCall */
+	pthread_mutex_t pianoMutex;
+	/* background playlist prefetch, see BarMainPrefetchPlaylist */
+	pthread_t prefetchThread;
+	bool prefetchRunning;
+	/* id of the station the prefetched playlist belongs to; a private copy,
+	 * the station itself may be deleted while the request is in flight */
+	char *prefetchStationId;
+	/* result; only touched by the main thread after the prefetch thread has
+	 * been joined */
+	PianoSong_t *prefetchPlaylist;
+	/* next-song precache: the stream is downloaded into a local file while
+	 * the current song plays, see BarMainPrecacheNext */
+	pthread_t precacheThread;
+	bool precacheRunning;
+	/* set by the thread when it is done and can be joined */
+	bool precacheDone;
+	/* download finished successfully and has not been consumed yet */
+	bool precacheComplete;
+	/* url the precache download belongs to */
+	char *precacheUrl;
+	/* two files, so a finished download can be played back while the next
+	 * one is being written */
+	char precacheFile[2][64];
+	unsigned int precacheSlot;
+	FILE *precacheFd;
+	WaitressHandle_t precacheWaith;
+	volatile bool precacheAbort;
+	/* station list loaded from the on-disk cache; the ui runs from it while
+	 * the refresh thread fetches the real list into ph.stations */
+	PianoStation_t *cachedStations;
+	pthread_t stationRefreshThread;
+	bool stationRefreshRunning;
+	/* set by the refresh thread when it is done and can be joined */
+	bool stationRefreshDone;
+	/* fresh station list has been fetched and applied */
+	bool stationsRefreshed;
 } BarApp_t;
 
 #endif /* SRC_MAIN_H_4ZGSCG6X */
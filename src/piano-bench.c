@@ -0,0 +1,595 @@
+/*
+Copyright (c) 2008-2013
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* end-to-end benchmark for the libpiano/libwaitress stack: a mock Pandora
+ * server on localhost replays canned json rpc responses (auth handshake,
+ * user.getStationList, station.getPlaylist) with optional injected latency
+ * and bandwidth shaping while the real PianoRequest -> WaitressFetchCall ->
+ * PianoResponse pipeline runs against it; measures per-command latency,
+ * connect overhead and parse time. run with `make bench`.
+ *
+ * usage: piano-bench [iterations] [latency ms] [bandwidth KiB/s]
+ */
+
+#ifndef __FreeBSD__
+#define _POSIX_C_SOURCE 200112L /* nanosleep(), snprintf() */
+#define _BSD_SOURCE /* strdup() */
+#define _DARWIN_C_SOURCE /* strdup() on OS X */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <piano.h>
+#include <crypt.h>
+#include <waitress.h>
+
+/*	mock server configuration, shared with the server thread
+ */
+typedef struct {
+	int listenFd;
+	/* injected delay before every response is sent */
+	unsigned int latencyMs;
+	/* response bandwidth cap, 0 means unlimited */
+	unsigned int bandwidthKibps;
+	/* timestamp encrypted with the partner key, replayed by partnerLogin */
+	const char *syncTime;
+	volatile bool quit;
+} BenchServer_t;
+
+/*	accumulated timings for one benchmarked command
+ */
+typedef struct {
+	int64_t fetchTime, parseTime;
+} BenchTimes_t;
+
+/*	microsecond timestamp, same clock BarUiPianoCall uses for its stats
+ */
+static int64_t BenchNow (void) {
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void BenchSleepMs (unsigned int ms) {
+	struct timespec ts = {ms / 1000, (long) (ms % 1000) * 1000000};
+	nanosleep (&ts, NULL);
+}
+
+/*	write buf to fd, optionally pacing the writes to emulate a slow link
+ */
+static bool BenchWriteShaped (const BenchServer_t * const srv, int fd,
+		const char *buf, size_t len) {
+	while (len > 0) {
+		size_t slice = len;
+		if (srv->bandwidthKibps > 0 && slice > 1024) {
+			slice = 1024;
+		}
+		const ssize_t written = write (fd, buf, slice);
+		if (written <= 0) {
+			return false;
+		}
+		buf += written;
+		len -= written;
+		if (srv->bandwidthKibps > 0) {
+			/* cap at bandwidthKibps by sleeping off each KiB slice */
+			struct timespec ts = {0, 1000000000L / srv->bandwidthKibps};
+			nanosleep (&ts, NULL);
+		}
+	}
+	return true;
+}
+
+/*	build the canned response body for the method requested in line; the
+ *	replies contain exactly the fields PianoResponse consumes
+ *	@return body size or 0 if the method is unknown
+ */
+static size_t BenchResponseBody (const BenchServer_t * const srv,
+		const char * const line, char * const body, size_t bodySize) {
+	if (strstr (line, "method=auth.partnerLogin") != NULL) {
+		return snprintf (body, bodySize, "{\"stat\":\"ok\",\"result\":{"
+				"\"partnerId\":42,"
+				"\"partnerAuthToken\":\"bench-partner-token\","
+				"\"syncTime\":\"%s\"}}", srv->syncTime);
+	} else if (strstr (line, "method=auth.userLogin") != NULL) {
+		return snprintf (body, bodySize, "{\"stat\":\"ok\",\"result\":{"
+				"\"userId\":\"bench-user\","
+				"\"userAuthToken\":\"bench-user-token\"}}");
+	} else if (strstr (line, "method=user.getStationList") != NULL) {
+		return snprintf (body, bodySize, "{\"stat\":\"ok\",\"result\":{"
+				"\"stations\":["
+				"{\"stationName\":\"Bench Radio\",\"stationToken\":\"100\","
+				"\"isShared\":false,\"isQuickMix\":false},"
+				"{\"stationName\":\"More Bench Radio\",\"stationToken\":\"101\","
+				"\"isShared\":true,\"isQuickMix\":false},"
+				"{\"stationName\":\"QuickMix\",\"stationToken\":\"102\","
+				"\"isShared\":false,\"isQuickMix\":true,"
+				"\"quickMixStationIds\":[\"100\"]}]}}");
+	} else if (strstr (line, "method=station.getPlaylist") != NULL) {
+		size_t off = snprintf (body, bodySize,
+				"{\"stat\":\"ok\",\"result\":{\"items\":[");
+		for (unsigned int i = 0; i < 4; i++) {
+			off += snprintf (body + off, bodySize - off, "%s{"
+					"\"artistName\":\"Bench Artist %u\","
+					"\"albumName\":\"Bench Album\","
+					"\"songName\":\"Bench Song %u\","
+					"\"trackToken\":\"token%u\","
+					"\"stationId\":\"100\","
+					"\"albumArtUrl\":\"http://localhost/art.jpg\","
+					"\"songDetailUrl\":\"http://localhost/detail\","
+					"\"trackGain\":0.0,\"trackLength\":180,\"songRating\":0,"
+					"\"audioUrlMap\":{\"highQuality\":{\"encoding\":\"mp3\","
+					"\"audioUrl\":\"http://localhost/bench.mp3\"}}}",
+					i == 0 ? "" : ",", i, i, i);
+		}
+		off += snprintf (body + off, bodySize - off, "]}}");
+		return off;
+	}
+	return 0;
+}
+
+/*	answer requests on one keep-alive connection until the client closes it
+ */
+static void BenchServeConnection (const BenchServer_t * const srv, int fd) {
+	char buf[16*1024];
+
+	while (!srv->quit) {
+		/* read until the header terminator, then drain the post body */
+		size_t filled = 0;
+		char *bodyStart = NULL;
+		while (bodyStart == NULL) {
+			if (filled >= sizeof (buf)-1) {
+				return;
+			}
+			const ssize_t recvd = read (fd, buf + filled,
+					sizeof (buf)-1 - filled);
+			if (recvd <= 0) {
+				return;
+			}
+			filled += recvd;
+			buf[filled] = '\0';
+			bodyStart = strstr (buf, "\r\n\r\n");
+		}
+		bodyStart += 4;
+
+		size_t contentLength = 0;
+		const char *cl = strstr (buf, "Content-Length:");
+		if (cl != NULL) {
+			contentLength = atol (cl + strlen ("Content-Length:"));
+		}
+		while (filled - (bodyStart - buf) < contentLength) {
+			if (filled >= sizeof (buf)-1) {
+				return;
+			}
+			const ssize_t recvd = read (fd, buf + filled,
+					sizeof (buf)-1 - filled);
+			if (recvd <= 0) {
+				return;
+			}
+			filled += recvd;
+			buf[filled] = '\0';
+		}
+
+		char body[8*1024];
+		const size_t bodyLen = BenchResponseBody (srv, buf, body,
+				sizeof (body));
+		if (bodyLen == 0) {
+			return;
+		}
+
+		if (srv->latencyMs > 0) {
+			BenchSleepMs (srv->latencyMs);
+		}
+
+		char header[256];
+		const size_t headerLen = snprintf (header, sizeof (header),
+				"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+				"Content-Length: %zu\r\nConnection: Keep-Alive\r\n\r\n",
+				bodyLen);
+		if (!BenchWriteShaped (srv, fd, header, headerLen) ||
+				!BenchWriteShaped (srv, fd, body, bodyLen)) {
+			return;
+		}
+	}
+}
+
+/*	one accepted connection, owned by its detached server thread
+ */
+typedef struct {
+	const BenchServer_t *srv;
+	int fd;
+} BenchConn_t;
+
+static void *BenchConnThread (void *data) {
+	BenchConn_t * const conn = data;
+
+	BenchServeConnection (conn->srv, conn->fd);
+	close (conn->fd);
+	free (conn);
+
+	return NULL;
+}
+
+/*	mock server main loop; one thread per connection, the concurrent pass
+ *	opens several at once
+ */
+static void *BenchServerThread (void *data) {
+	BenchServer_t * const srv = data;
+	pthread_attr_t attr;
+
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+
+	while (!srv->quit) {
+		struct pollfd probe = {srv->listenFd, POLLIN, 0};
+		if (poll (&probe, 1, 100) <= 0) {
+			continue;
+		}
+		const int fd = accept (srv->listenFd, NULL, NULL);
+		if (fd == -1) {
+			continue;
+		}
+		BenchConn_t * const conn = malloc (sizeof (*conn));
+		pthread_t thread;
+		if (conn == NULL) {
+			close (fd);
+			continue;
+		}
+		conn->srv = srv;
+		conn->fd = fd;
+		if (pthread_create (&thread, &attr, BenchConnThread, conn) != 0) {
+			/* serve in place, losing the overlap */
+			BenchConnThread (conn);
+		}
+	}
+
+	pthread_attr_destroy (&attr);
+	return NULL;
+}
+
+/*	feed response chunks into libpiano's streaming json parser, same as
+ *	src/ui.c does
+ */
+static WaitressCbReturn_t BenchResponseCb (void *recvData,
+		size_t recvDataSize, void *extraData) {
+	PianoRequest_t * const req = extraData;
+
+	if (PianoResponseFeed (req, recvData, recvDataSize) != PIANO_RET_OK) {
+		return WAITRESS_CB_RET_ERR;
+	}
+	return WAITRESS_CB_RET_OK;
+}
+
+/*	drive one command through the real request/fetch/parse pipeline,
+ *	modeled on BarUiPianoCallUnlocked; fetch and parse time accumulate
+ *	into times
+ *	@return true on success
+ */
+static bool BenchPianoCall (PianoHandle_t * const ph,
+		WaitressHandle_t * const waith, PianoRequestType_t type, void *data,
+		BenchTimes_t * const times) {
+	PianoRequest_t req;
+	PianoReturn_t pRet;
+
+	memset (&req, 0, sizeof (req));
+
+	do {
+		req.data = data;
+
+		if ((pRet = PianoRequest (ph, &req, type)) != PIANO_RET_OK) {
+			fprintf (stderr, "request error: %s\n", PianoErrorToStr (pRet));
+			PianoDestroyRequest (&req);
+			return false;
+		}
+
+		waith->extraHeaders = "Content-Type: text/plain\r\n";
+		waith->postData = req.postData;
+		waith->method = WAITRESS_METHOD_POST;
+		waith->url.path = req.urlPath;
+		/* the mock server speaks plain http only */
+		waith->url.tls = false;
+		waith->data = &req;
+		waith->callback = BenchResponseCb;
+
+		const int64_t start = BenchNow ();
+		const WaitressReturn_t wRet = WaitressFetchCall (waith);
+		const int64_t fetched = BenchNow ();
+		if (wRet != WAITRESS_RET_OK) {
+			fprintf (stderr, "network error: %s\n",
+					WaitressErrorToStr (wRet));
+			free (req.responseData);
+			PianoDestroyRequest (&req);
+			return false;
+		}
+
+		pRet = PianoResponse (ph, &req);
+		times->fetchTime += fetched - start;
+		times->parseTime += BenchNow () - fetched;
+		if (pRet != PIANO_RET_OK && pRet != PIANO_RET_CONTINUE_REQUEST) {
+			fprintf (stderr, "response error: %s\n", PianoErrorToStr (pRet));
+			free (req.responseData);
+			PianoDestroyRequest (&req);
+			return false;
+		}
+
+		free (req.responseData);
+		PianoDestroyRequest (&req);
+	} while (pRet == PIANO_RET_CONTINUE_REQUEST);
+
+	return true;
+}
+
+/*	tear down the connection pool and dns cache, so the next request pays
+ *	the full connect cost again
+ */
+static void BenchResetConnection (WaitressHandle_t * const waith,
+		const char * const port) {
+	WaitressFree (waith);
+	WaitressInit (waith);
+	waith->url.host = "127.0.0.1";
+	waith->url.port = (char *) port;
+}
+
+/*	run iterations of one command and print min/avg/max total time plus the
+ *	fetch/parse split; freshConnect measures connect overhead by dropping
+ *	the keep-alive connection before every iteration
+ */
+static bool BenchRun (const char * const name, PianoHandle_t * const ph,
+		WaitressHandle_t * const waith, const char * const port,
+		PianoRequestType_t type, void *data, unsigned int iterations,
+		bool freshConnect) {
+	BenchTimes_t total = {0, 0};
+	int64_t min = INT64_MAX, max = 0;
+
+	for (unsigned int i = 0; i < iterations; i++) {
+		if (freshConnect) {
+			BenchResetConnection (waith, port);
+		}
+		if (type == PIANO_REQUEST_GET_STATIONS) {
+			/* the station list is replaced wholesale on every call */
+			PianoDestroyStations (ph->stations);
+			ph->stations = NULL;
+		}
+
+		BenchTimes_t one = {0, 0};
+		if (!BenchPianoCall (ph, waith, type, data, &one)) {
+			return false;
+		}
+		if (type == PIANO_REQUEST_GET_PLAYLIST) {
+			PianoRequestDataGetPlaylist_t * const reqData = data;
+			PianoDestroyPlaylist (reqData->retPlaylist);
+			reqData->retPlaylist = NULL;
+		}
+
+		const int64_t elapsed = one.fetchTime + one.parseTime;
+		if (elapsed < min) {
+			min = elapsed;
+		}
+		if (elapsed > max) {
+			max = elapsed;
+		}
+		total.fetchTime += one.fetchTime;
+		total.parseTime += one.parseTime;
+	}
+
+	printf ("%-28s %6" PRId64 " / %6" PRId64 " / %6" PRId64 " us"
+			"  (fetch %" PRId64 " us, parse %" PRId64 " us)\n", name, min,
+			(total.fetchTime + total.parseTime) / iterations, max,
+			total.fetchTime / iterations, total.parseTime / iterations);
+	return true;
+}
+
+/*	run iterations of several concurrent getPlaylist fetches through
+ *	WaitressMultiFetchCall; the network transfers overlap, the libpiano
+ *	request/response halves stay serial like a pianoMutex holder would
+ */
+static bool BenchRunMulti (PianoHandle_t * const ph,
+		const char * const port, unsigned int iterations) {
+	enum { entryCount = 4 };
+	int64_t total = 0, min = INT64_MAX, max = 0;
+
+	for (unsigned int i = 0; i < iterations; i++) {
+		WaitressHandle_t waith[entryCount];
+		PianoRequest_t req[entryCount];
+		PianoRequestDataGetPlaylist_t reqData[entryCount];
+		WaitressMulti_t multi[entryCount];
+		bool ok = true;
+
+		for (size_t k = 0; k < entryCount; k++) {
+			memset (&req[k], 0, sizeof (req[k]));
+			reqData[k].station = ph->stations;
+			reqData[k].quality = PIANO_AQ_HIGH;
+			reqData[k].retPlaylist = NULL;
+			req[k].data = &reqData[k];
+			if (PianoRequest (ph, &req[k], PIANO_REQUEST_GET_PLAYLIST) !=
+					PIANO_RET_OK) {
+				ok = false;
+			}
+
+			WaitressInit (&waith[k]);
+			waith[k].url.host = "127.0.0.1";
+			waith[k].url.port = (char *) port;
+			waith[k].url.path = req[k].urlPath;
+			waith[k].url.tls = false;
+			waith[k].extraHeaders = "Content-Type: text/plain\r\n";
+			waith[k].postData = req[k].postData;
+			waith[k].method = WAITRESS_METHOD_POST;
+			waith[k].data = &req[k];
+			waith[k].callback = BenchResponseCb;
+			multi[k].waith = &waith[k];
+		}
+
+		const int64_t start = BenchNow ();
+		if (ok && WaitressMultiFetchCall (multi, entryCount) !=
+				WAITRESS_RET_OK) {
+			fprintf (stderr, "network error: %s\n",
+					WaitressErrorToStr (multi[0].ret));
+			ok = false;
+		}
+		const int64_t elapsed = BenchNow () - start;
+
+		for (size_t k = 0; k < entryCount; k++) {
+			if (ok && PianoResponse (ph, &req[k]) != PIANO_RET_OK) {
+				ok = false;
+			}
+			PianoDestroyPlaylist (reqData[k].retPlaylist);
+			free (req[k].responseData);
+			PianoDestroyRequest (&req[k]);
+			WaitressFree (&waith[k]);
+		}
+		if (!ok) {
+			return false;
+		}
+
+		if (elapsed < min) {
+			min = elapsed;
+		}
+		if (elapsed > max) {
+			max = elapsed;
+		}
+		total += elapsed;
+	}
+
+	printf ("%-28s %6" PRId64 " / %6" PRId64 " / %6" PRId64 " us"
+			"  (%u fetches each)\n", "getPlaylist (concurrent)", min,
+			total / iterations, max, (unsigned int) entryCount);
+	return true;
+}
+
+int main (int argc, char **argv) {
+	/* the partner key pair is ours, so in and out can share one key; the
+	 * server's encrypted syncTime then decrypts correctly */
+	static const char key[] = "benchbenchbench1";
+	BenchServer_t srv;
+	PianoHandle_t ph;
+	WaitressHandle_t waith;
+	char port[16];
+
+	memset (&srv, 0, sizeof (srv));
+	const unsigned int iterations = argc > 1 ? atoi (argv[1]) : 100;
+	srv.latencyMs = argc > 2 ? atoi (argv[2]) : 0;
+	srv.bandwidthKibps = argc > 3 ? atoi (argv[3]) : 0;
+	if (iterations == 0) {
+		fprintf (stderr, "usage: %s [iterations] [latency ms] "
+				"[bandwidth KiB/s]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* dead keep-alive connections surface as write errors, not signals */
+	signal (SIGPIPE, SIG_IGN);
+
+	if (PianoInit (&ph, "benchpartner", "benchpassword", "benchdevice", key,
+			key) != PIANO_RET_OK) {
+		fprintf (stderr, "cannot initialize libpiano\n");
+		return EXIT_FAILURE;
+	}
+
+	/* syncTime is four junk bytes followed by the decimal timestamp, see
+	 * PianoResponse */
+	char plainTime[32];
+	snprintf (plainTime, sizeof (plainTime), "0000%lu",
+			(unsigned long) time (NULL));
+	char * const cryptTime = PianoEncryptString (ph.partner.out, plainTime);
+	assert (cryptTime != NULL);
+	srv.syncTime = cryptTime;
+
+	/* bind the mock server to an ephemeral port */
+	struct sockaddr_in addr;
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	socklen_t addrLen = sizeof (addr);
+	if ((srv.listenFd = socket (AF_INET, SOCK_STREAM, 0)) == -1 ||
+			bind (srv.listenFd, (struct sockaddr *) &addr,
+					sizeof (addr)) == -1 ||
+			listen (srv.listenFd, 1) == -1 ||
+			getsockname (srv.listenFd, (struct sockaddr *) &addr,
+					&addrLen) == -1) {
+		perror ("mock server setup");
+		return EXIT_FAILURE;
+	}
+	snprintf (port, sizeof (port), "%u", ntohs (addr.sin_port));
+
+	pthread_t serverThread;
+	pthread_create (&serverThread, NULL, BenchServerThread, &srv);
+
+	WaitressInit (&waith);
+	waith.url.host = "127.0.0.1";
+	waith.url.port = port;
+
+	printf ("mock server on 127.0.0.1:%s, %u iterations, %u ms latency, "
+			"%u KiB/s\n", port, iterations, srv.latencyMs,
+			srv.bandwidthKibps);
+	printf ("%-28s %s\n", "command", "min / avg / max");
+
+	bool ok = false;
+	PianoRequestDataLogin_t loginData = {"bench@example.com", "secret", 0};
+	BenchTimes_t loginTimes = {0, 0};
+	const int64_t loginStart = BenchNow ();
+	/* two-step auth handshake on a fresh connection */
+	if (BenchPianoCall (&ph, &waith, PIANO_REQUEST_LOGIN, &loginData,
+			&loginTimes)) {
+		printf ("%-28s %6" PRId64 " us  (fetch %" PRId64 " us, parse %"
+				PRId64 " us)\n", "login (fresh connect)",
+				BenchNow () - loginStart, loginTimes.fetchTime,
+				loginTimes.parseTime);
+
+		PianoRequestDataGetPlaylist_t playlistData;
+		memset (&playlistData, 0, sizeof (playlistData));
+		playlistData.quality = PIANO_AQ_HIGH;
+
+		ok = BenchRun ("getStationList (keep-alive)", &ph, &waith, port,
+						PIANO_REQUEST_GET_STATIONS, NULL, iterations, false) &&
+				(playlistData.station = ph.stations) != NULL &&
+				BenchRun ("getPlaylist (keep-alive)", &ph, &waith, port,
+						PIANO_REQUEST_GET_PLAYLIST, &playlistData, iterations,
+						false) &&
+				BenchRun ("getPlaylist (fresh connect)", &ph, &waith, port,
+						PIANO_REQUEST_GET_PLAYLIST, &playlistData, iterations,
+						true) &&
+				BenchRunMulti (&ph, port, iterations);
+	}
+
+	srv.quit = true;
+	pthread_join (serverThread, NULL);
+	close (srv.listenFd);
+	WaitressFree (&waith);
+	PianoDestroy (&ph);
+	free (cryptTime);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
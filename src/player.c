@@ -23,7 +23,12 @@ THE SOFTWARE.
 
 /* receive/play audio stream */
 
+#ifndef __FreeBSD__
+#define _POSIX_C_SOURCE 200112L /* posix_fallocate() */
+#endif
+
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <string.h>
@@ -48,9 +53,7 @@ THE SOFTWARE.
 #endif
 #include <libavutil/channel_layout.h>
 #include <libavutil/opt.h>
-#ifndef HAVE_AV_TIMEOUT
 #include <libavutil/time.h>
-#endif
 
 #include "player.h"
 #include "ui.h"
@@ -59,6 +62,17 @@ THE SOFTWARE.
 /* default sample format */
 const enum AVSampleFormat avformat = AV_SAMPLE_FMT_S16;
 
+/* an av_read_frame call taking longer than this (us) counts as a network
+ * stall, see BarMainAdaptQuality in main.c */
+#define BAR_PLAYER_STALL_US (500 * 1000)
+
+/* audio device kept open across songs as long as the format matches;
+ * pandora's streams are uniformly encoded, so this avoids per-song device
+ * churn (and the audible click on some sinks). only ever touched by the
+ * player thread, and there is at most one of those. */
+static ao_device *persistDev = NULL;
+static ao_sample_format persistFmt;
+
 static void printError (const BarSettings_t * const settings,
         const char * const msg, int ret) {
     char avmsg[128];
@@ -79,15 +93,29 @@ void BarPlayerInit () {
 }
 
 void BarPlayerDestroy () {
+    if (persistDev != NULL) {
+        ao_close (persistDev);
+        persistDev = NULL;
+    }
     avformat_network_deinit ();
     avfilter_uninit ();
     ao_shutdown ();
 }
 
-/*  Update volume filter
+/*  Update volume: the decode thread picks the new gain factor up with the
+ *  next frame; the filter graph is only updated when it is actually in use
  */
 void BarPlayerSetVolume (player_t * const player) {
     assert (player != NULL);
+
+    /* convert from decibel */
+    player->volumeScale = pow (10,
+            (player->settings->volume + player->gain) / 20);
+
+    if (player->fgraph == NULL) {
+        /* direct volume path, nothing else to do */
+        return;
+    }
     assert (player->fvolume != NULL);
 
     int ret;
@@ -133,6 +161,175 @@ static int intCb (void * const data) {
 #define ping()
 #endif
 
+/*  writer thread: flush remuxed packets to the save file; runs detached from
+ *  the decode/playback path so a slow disk (nfs, sd card) cannot stall audio
+ */
+static void *BarPlayerWriteThread (void *data) {
+    player_t * const player = data;
+
+    pthread_mutex_lock (&player->writeMutex);
+    while (true) {
+        while (player->writeHead == NULL && !player->writeDone) {
+            pthread_cond_wait (&player->writeCond, &player->writeMutex);
+        }
+        if (player->writeHead == NULL) {
+            break;
+        }
+
+        BarWritePkt_t * const item = player->writeHead;
+        player->writeHead = item->next;
+        if (player->writeHead == NULL) {
+            player->writeTail = NULL;
+        }
+        pthread_mutex_unlock (&player->writeMutex);
+
+        av_write_frame (player->ofcx, &item->pkt);
+        av_free_packet (&item->pkt);
+        free (item);
+
+        pthread_mutex_lock (&player->writeMutex);
+    }
+    pthread_mutex_unlock (&player->writeMutex);
+
+    return NULL;
+}
+
+/*  hand a cloned packet to the writer thread
+ */
+static void BarPlayerWritePush (player_t * const player,
+        const AVPacket * const pkt) {
+    BarWritePkt_t * const item = malloc (sizeof (*item));
+    assert (item != NULL);
+
+    item->pkt = *pkt;
+    item->next = NULL;
+    /* clone payload, the caller frees the original packet */
+    if (av_dup_packet (&item->pkt) < 0) {
+        free (item);
+        return;
+    }
+
+    pthread_mutex_lock (&player->writeMutex);
+    if (player->writeTail != NULL) {
+        player->writeTail->next = item;
+    } else {
+        player->writeHead = item;
+    }
+    player->writeTail = item;
+    pthread_cond_signal (&player->writeCond);
+    pthread_mutex_unlock (&player->writeMutex);
+}
+
+/*  stop the writer thread, flushing everything still queued
+ */
+static void closeWriteThread (player_t * const player) {
+    if (!player->writeThreadStarted) {
+        return;
+    }
+
+    pthread_mutex_lock (&player->writeMutex);
+    player->writeDone = true;
+    pthread_cond_broadcast (&player->writeCond);
+    pthread_mutex_unlock (&player->writeMutex);
+    pthread_join (player->writeThread, NULL);
+
+    player->writeThreadStarted = false;
+    player->writeDone = false;
+}
+
+/*  write callback for the buffered save-file avio context */
+static int BarPlayerSaveWrite (void *opaque, uint8_t *buf, int size) {
+    player_t * const player = opaque;
+    int written = 0;
+
+    while (written < size) {
+        const ssize_t ret = write (player->saveFd, buf + written,
+                size - written);
+        if (ret < 0) {
+            return -1;
+        }
+        written += ret;
+    }
+
+    player->saveOffset += written;
+    if (player->saveOffset > player->saveMaxOffset) {
+        player->saveMaxOffset = player->saveOffset;
+    }
+
+    return written;
+}
+
+/*  seek callback for the buffered save-file avio context */
+static int64_t BarPlayerSaveSeek (void *opaque, int64_t offset, int whence) {
+    player_t * const player = opaque;
+
+    if ((whence & AVSEEK_SIZE) != 0) {
+        return -1;
+    }
+
+    const off_t pos = lseek (player->saveFd, offset, whence & ~AVSEEK_FORCE);
+    if (pos >= 0) {
+        player->saveOffset = pos;
+    }
+    return pos;
+}
+
+/*  open the save file behind an avio context with a large coalescing write
+ *  buffer, so packets reach the disk as sequential buffer-sized writes
+ *  instead of thousands of tiny ones, and preallocate the expected file
+ *  size (duration * bitrate) against fragmentation
+ */
+static bool openSaveFile (player_t * const player,
+        AVFormatContext * const ofcx, const char * const filename) {
+    player->saveFd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (player->saveFd < 0) {
+        BarUiMsg (player->settings, MSG_ERR, "Cannot open save file.\n");
+        return false;
+    }
+    player->saveOffset = 0;
+    player->saveMaxOffset = 0;
+
+    if (player->songDuration > 0 && player->fctx->bit_rate > 0) {
+        posix_fallocate (player->saveFd, 0,
+                (off_t) player->songDuration *
+                (player->fctx->bit_rate / 8));
+    }
+
+    const size_t bufSize = player->settings->saveWriteBuffer;
+    unsigned char * const buf = av_malloc (bufSize);
+    if (buf == NULL || (ofcx->pb = avio_alloc_context (buf, bufSize, 1,
+            player, NULL, BarPlayerSaveWrite, BarPlayerSaveSeek)) == NULL) {
+        av_free (buf);
+        close (player->saveFd);
+        player->saveFd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+/*  flush, trim and close the save file; data is fsynced so it is really on
+ *  disk before the finished file is moved into place
+ */
+static void closeSaveFile (player_t * const player, const bool completed) {
+    if (completed) {
+        avio_flush (player->ofcx->pb);
+        /* cut off the preallocated tail; the trailer may have seeked back
+         * to patch the header, so the current position is not the end of
+         * the data, the high-water mark is */
+        if (player->saveMaxOffset > 0) {
+            ftruncate (player->saveFd, player->saveMaxOffset);
+        }
+        fsync (player->saveFd);
+    }
+
+    av_free (player->ofcx->pb->buffer);
+    av_free (player->ofcx->pb);
+    player->ofcx->pb = NULL;
+    close (player->saveFd);
+    player->saveFd = -1;
+}
+
 static bool openStream (player_t * const player) {
     assert (player != NULL);
     /* no leak? */
@@ -145,7 +342,20 @@ static bool openStream (player_t * const player) {
 #ifdef HAVE_AV_TIMEOUT
     /* 10 seconds timeout on TCP r/w */
     av_dict_set (&options, "timeout", "10000000", 0);
-#else
+#endif
+    if (player->resumeOffset > 0) {
+        /* resume an interrupted song with a range request, so only the
+         * remaining tail is fetched; pandora's adts/mp3 streams are
+         * self-synchronizing, decoding continues right at the resume
+         * position */
+        char headers[64];
+        snprintf (headers, sizeof (headers), "Range: bytes=%" PRId64 "-\r\n",
+                player->resumeOffset);
+        av_dict_set (&options, "headers", headers, 0);
+        /* timestamps restart at the resume position */
+        player->resumePlayed = player->songPlayed;
+    }
+#ifndef HAVE_AV_TIMEOUT
     /* libav does not support the timeout option above. the workaround stores
      * the current time with ping() now and then, registers an interrupt
      * callback (below) and compares saved/current time in this callback. it’s
@@ -192,14 +402,19 @@ static bool openStream (player_t * const player) {
         softfail ("codec_open2");
     }
 
-    if (player->lastTimestamp > 0) {
+    if (player->lastTimestamp > 0 && player->resumeOffset == 0) {
+        /* fallback when no byte position is known: skip by timestamp, which
+         * re-downloads everything before the seek point */
         ping ();
         av_seek_frame (player->fctx, player->streamIdx, player->lastTimestamp, 0);
     }
 
     player->songPlayed = 0;
-    player->songDuration = av_q2d (player->st->time_base) *
-            (double) player->st->duration;
+    if (player->resumeOffset == 0) {
+        /* on resume the tail-only stream would report a too short duration */
+        player->songDuration = av_q2d (player->st->time_base) *
+                (double) player->st->duration;
+    }
     player->mode = PLAYER_PLAYING;
 
     char *save_dir = player->settings->save_dir;
@@ -266,8 +481,13 @@ static bool openStream (player_t * const player) {
         ofmt = av_guess_format( NULL, tmp_filename, NULL);
         ofcx = avformat_alloc_context();
         ofcx->oformat = ofmt;
-        avio_open2(&ofcx->pb, tmp_filename, AVIO_FLAG_WRITE, NULL, NULL);
+        if (!openSaveFile (player, ofcx, tmp_filename)) {
+            avformat_free_context (ofcx);
+            player->save_file = false;
+        }
+    }
 
+    if ( player->save_file ){
         ost = avformat_new_stream( ofcx, NULL);
         avcodec_copy_context( ost->codec, player->st->codec);
 
@@ -280,6 +500,79 @@ static bool openStream (player_t * const player) {
     player->ofcx = ofcx;
     player->ost = ost;
 
+    if ( player->save_file ){
+        player->writeHead = player->writeTail = NULL;
+        player->writeDone = false;
+        pthread_create (&player->writeThread, NULL, BarPlayerWriteThread,
+                player);
+        player->writeThreadStarted = true;
+    }
+
+    return true;
+}
+
+/*  clip and convert one sample to s16
+ */
+static inline int16_t clipSample (const float sample) {
+    if (sample > INT16_MAX) {
+        return INT16_MAX;
+    } else if (sample < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t) sample;
+}
+
+/*  convert a decoded frame to interleaved s16 and apply the gain factor in
+ *  one pass; handles the sample formats pandora's aac/mp3 streams actually
+ *  produce, everything else goes through the filter graph. the loops are
+ *  simple enough for the compiler to vectorize.
+ */
+static bool convertFrame (const AVFrame * const frame, const double scale,
+        int16_t * const out) {
+    const int channels = av_get_channel_layout_nb_channels (
+            frame->channel_layout);
+    const int samples = frame->nb_samples;
+
+    switch (frame->format) {
+        case AV_SAMPLE_FMT_S16: {
+            const int16_t * const in = (const int16_t *) frame->data[0];
+            for (int i = 0; i < samples * channels; i++) {
+                out[i] = clipSample ((float) in[i] * scale);
+            }
+            break;
+        }
+
+        case AV_SAMPLE_FMT_S16P:
+            for (int c = 0; c < channels; c++) {
+                const int16_t * const in = (const int16_t *) frame->data[c];
+                for (int i = 0; i < samples; i++) {
+                    out[i * channels + c] = clipSample ((float) in[i] * scale);
+                }
+            }
+            break;
+
+        case AV_SAMPLE_FMT_FLT: {
+            const float * const in = (const float *) frame->data[0];
+            for (int i = 0; i < samples * channels; i++) {
+                out[i] = clipSample (in[i] * scale * INT16_MAX);
+            }
+            break;
+        }
+
+        case AV_SAMPLE_FMT_FLTP:
+            for (int c = 0; c < channels; c++) {
+                const float * const in = (const float *) frame->data[c];
+                for (int i = 0; i < samples; i++) {
+                    out[i * channels + c] =
+                            clipSample (in[i] * scale * INT16_MAX);
+                }
+            }
+            break;
+
+        default:
+            return false;
+    }
+
     return true;
 }
 
@@ -291,6 +584,21 @@ static bool openFilter (player_t * const player) {
     int ret = 0;
     AVCodecContext * const cctx = player->st->codec;
 
+    /* common sample formats are converted by convertFrame, no filter graph
+     * required */
+    switch (cctx->sample_fmt) {
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+            player->directVolume = true;
+            BarPlayerSetVolume (player);
+            return true;
+
+        default:
+            break;
+    }
+
     if ((player->fgraph = avfilter_graph_alloc ()) == NULL) {
         softfail ("graph_alloc");
     }
@@ -347,7 +655,7 @@ static bool openFilter (player_t * const player) {
     return true;
 }
 
-/*  setup libao
+/*  setup libao, reusing the device from the previous song if possible
  */
 static bool openDevice (player_t * const player) {
     AVCodecContext * const cctx = player->st->codec;
@@ -360,11 +668,110 @@ static bool openDevice (player_t * const player) {
     aoFmt.rate = cctx->sample_rate;
     aoFmt.byte_format = AO_FMT_NATIVE;
 
+    if (persistDev != NULL) {
+        if (persistFmt.bits == aoFmt.bits &&
+                persistFmt.channels == aoFmt.channels &&
+                persistFmt.rate == aoFmt.rate &&
+                persistFmt.byte_format == aoFmt.byte_format) {
+            player->aoDev = persistDev;
+            return true;
+        }
+        /* format changed, reopen */
+        ao_close (persistDev);
+        persistDev = NULL;
+    }
+
     int driver = ao_default_driver_id ();
     if ((player->aoDev = ao_open_live (driver, &aoFmt, NULL)) == NULL) {
         BarUiMsg (player->settings, MSG_ERR, "Cannot open audio device.\n");
         return false;
     }
+    persistDev = player->aoDev;
+    persistFmt = aoFmt;
+
+    return true;
+}
+
+/*  playback thread: drain decoded pcm chunks into libao, so network stalls
+ *  in av_read_frame no longer cause audible dropouts
+ */
+static void *BarPlayerPlaybackThread (void *data) {
+    player_t * const player = data;
+
+    bool started = false;
+
+    pthread_mutex_lock (&player->pcmMutex);
+    while (true) {
+        if (started && player->pcmFill == 0 && !player->pcmDone &&
+                !player->doQuit) {
+            /* the sink ran dry while the decoder is still working */
+            ++player->underruns;
+        }
+        while (player->pcmFill == 0 && !player->pcmDone && !player->doQuit) {
+            pthread_cond_wait (&player->pcmNotEmpty, &player->pcmMutex);
+        }
+        if (player->pcmFill == 0 || player->doQuit) {
+            /* drained or skipped; leftover chunks are freed by play() */
+            break;
+        }
+
+        BarPcmChunk_t chunk = player->pcmBuf[player->pcmRead];
+        player->pcmRead = (player->pcmRead + 1) % BAR_PLAYER_PCM_SLOTS;
+        --player->pcmFill;
+        pthread_cond_signal (&player->pcmNotFull);
+        pthread_mutex_unlock (&player->pcmMutex);
+
+        /* pausing; handled here (not just in the decoder) so it takes effect
+         * immediately instead of after the decode-ahead buffer has drained */
+        pthread_mutex_lock (&player->pauseMutex);
+        while (player->doPause && !player->doQuit) {
+            pthread_cond_wait (&player->pauseCond, &player->pauseMutex);
+        }
+        pthread_mutex_unlock (&player->pauseMutex);
+
+        if (!player->doQuit) {
+            const int64_t playStart = av_gettime ();
+            ao_play (player->aoDev, chunk.data, chunk.size);
+            player->playTime += av_gettime () - playStart;
+            ++player->playedChunks;
+            player->songPlayed = chunk.songPlayed;
+            started = true;
+        }
+        free (chunk.data);
+
+        pthread_mutex_lock (&player->pcmMutex);
+    }
+    /* wake up a decoder blocked on a full ring */
+    pthread_cond_broadcast (&player->pcmNotFull);
+    pthread_mutex_unlock (&player->pcmMutex);
+
+    return NULL;
+}
+
+/*  append decoded pcm to the ring buffer, blocks while it is full
+ *  @return false if the player is shutting down
+ */
+static bool BarPlayerPcmPush (player_t * const player, const char * const data,
+        const size_t size, const unsigned int songPlayed) {
+    pthread_mutex_lock (&player->pcmMutex);
+    while (player->pcmFill == BAR_PLAYER_PCM_SLOTS && !player->doQuit) {
+        pthread_cond_wait (&player->pcmNotFull, &player->pcmMutex);
+    }
+    if (player->doQuit) {
+        pthread_mutex_unlock (&player->pcmMutex);
+        return false;
+    }
+
+    BarPcmChunk_t * const chunk = &player->pcmBuf[player->pcmWrite];
+    chunk->data = malloc (size);
+    assert (chunk->data != NULL);
+    memcpy (chunk->data, data, size);
+    chunk->size = size;
+    chunk->songPlayed = songPlayed;
+    player->pcmWrite = (player->pcmWrite + 1) % BAR_PLAYER_PCM_SLOTS;
+    ++player->pcmFill;
+    pthread_cond_signal (&player->pcmNotEmpty);
+    pthread_mutex_unlock (&player->pcmMutex);
 
     return true;
 }
@@ -387,24 +794,55 @@ static int play (player_t * const player) {
     filteredFrame = avcodec_alloc_frame ();
     assert (filteredFrame != NULL);
 
+    /* reused conversion buffer for the direct volume path */
+    int16_t *scratch = NULL;
+    size_t scratchSize = 0;
+
+    /* start the playback thread draining the decode-ahead buffer; capture
+     * contexts only remux and have nothing to play back */
+    player->pcmRead = player->pcmWrite = player->pcmFill = 0;
+    player->pcmDone = false;
+    pthread_t playbackThread;
+    if (!player->captureOnly) {
+        pthread_create (&playbackThread, NULL, BarPlayerPlaybackThread,
+                player);
+    }
+
+    int readRet = 0;
+
     while (!player->doQuit) {
         ping ();
+        const int64_t readStart = av_gettime ();
         int ret = av_read_frame (player->fctx, &pkt);
+        const int64_t readSpent = av_gettime () - readStart;
+        player->readTime += readSpent;
+        if (readSpent > BAR_PLAYER_STALL_US) {
+            ++player->readStalls;
+        }
         if (ret < 0) {
             av_free_packet (&pkt);
-            return ret;
-        } else if (pkt.stream_index != player->streamIdx) {
+            readRet = ret;
+            break;
+        }
+        player->bytesReceived += pkt.size;
+        if (pkt.stream_index != player->streamIdx) {
             av_free_packet (&pkt);
             continue;
         }
 
+        /* remember the read position for resume-by-range */
+        const int64_t streamPos = avio_tell (player->fctx->pb);
+        if (streamPos > 0) {
+            player->resumeOffset = streamPos;
+        }
+
         AVPacket pkt_orig = pkt;
         AVPacket pkt_write = pkt;
 
         player->pkt_write = pkt;
 
         if ( player->save_file ){
-            pkt_write.stream_index = player->ost->id; 
+            pkt_write.stream_index = player->ost->id;
             pkt_write.pts = av_rescale_q(
                 pkt_write.pts,
                 player->fctx->streams[0]->codec->time_base,
@@ -415,7 +853,7 @@ static int play (player_t * const player) {
                 player->fctx->streams[0]->codec->time_base,
                 player->ofcx->streams[0]->time_base
             );
-            av_write_frame( player->ofcx, &pkt_write);
+            BarPlayerWritePush (player, &pkt_write);
         }
 
 
@@ -434,18 +872,50 @@ static int play (player_t * const player) {
         }
         pthread_mutex_unlock (&player->pauseMutex);
 
+        if (player->captureOnly) {
+            /* the packet went to the save-file queue above, nothing to
+             * decode */
+            player->songPlayed = player->resumePlayed +
+                    av_q2d (player->st->time_base) * (double) pkt.pts;
+            av_free_packet (&pkt_orig);
+            player->lastTimestamp = pkt.pts;
+            continue;
+        }
+
         do {
             int got_frame = 0;
 
+            const int64_t decodeStart = av_gettime ();
             const int decoded = avcodec_decode_audio4 (player->st->codec,
                     frame, &got_frame, &pkt);
+            player->decodeTime += av_gettime () - decodeStart;
             if (decoded < 0) {
                 /* skip this one */
                 break;
             }
+            if (got_frame != 0) {
+                ++player->decodedFrames;
+            }
 
 
-            if (got_frame != 0) {
+            if (got_frame != 0 && player->directVolume) {
+                /* fast path: scale/convert in one pass, no filter graph */
+                const int numChannels = av_get_channel_layout_nb_channels (
+                        frame->channel_layout);
+                const size_t size = frame->nb_samples * numChannels *
+                        sizeof (int16_t);
+                if (size > scratchSize) {
+                    scratch = realloc (scratch, size);
+                    assert (scratch != NULL);
+                    scratchSize = size;
+                }
+                const unsigned int songPlayed = player->resumePlayed +
+                        av_q2d (player->st->time_base) * (double) pkt.pts;
+                if (convertFrame (frame, player->volumeScale, scratch)) {
+                    BarPlayerPcmPush (player, (char *) scratch, size,
+                            songPlayed);
+                }
+            } else if (got_frame != 0) {
 
 
                 /* XXX: suppresses warning from resample filter */
@@ -474,8 +944,15 @@ static int play (player_t * const player) {
                     const int numChannels = av_get_channel_layout_nb_channels (
                             filteredFrame->channel_layout);
                     const int bps = av_get_bytes_per_sample(filteredFrame->format);
-                    ao_play (player->aoDev, (char *) filteredFrame->data[0],
-                            filteredFrame->nb_samples * numChannels * bps);
+                    const unsigned int songPlayed = player->resumePlayed +
+                            av_q2d (player->st->time_base) * (double) pkt.pts;
+                    if (!BarPlayerPcmPush (player,
+                            (char *) filteredFrame->data[0],
+                            filteredFrame->nb_samples * numChannels * bps,
+                            songPlayed)) {
+                        avfilter_unref_bufferp (&audioref);
+                        break;
+                    }
 
                     avfilter_unref_bufferp (&audioref);
                 }
@@ -487,19 +964,39 @@ static int play (player_t * const player) {
 
         av_free_packet (&pkt_orig);
 
-        player->songPlayed = av_q2d (player->st->time_base) * (double) pkt.pts;
+        /* songPlayed is updated by the playback thread, it lags behind the
+         * decoder by the buffered amount */
         player->lastTimestamp = pkt.pts;
     }
 
+    /* let the playback thread drain the buffer, then collect it */
+    if (!player->captureOnly) {
+        pthread_mutex_lock (&player->pcmMutex);
+        player->pcmDone = true;
+        pthread_cond_broadcast (&player->pcmNotEmpty);
+        pthread_mutex_unlock (&player->pcmMutex);
+        pthread_join (playbackThread, NULL);
+    }
+
+    /* free chunks left over after a skip */
+    while (player->pcmFill > 0) {
+        free (player->pcmBuf[player->pcmRead].data);
+        player->pcmRead = (player->pcmRead + 1) % BAR_PLAYER_PCM_SLOTS;
+        --player->pcmFill;
+    }
+
+    free (scratch);
     avcodec_free_frame (&filteredFrame);
     avcodec_free_frame (&frame);
 
 
-    return 0;
+    return readRet;
 }
 
 static void finish (player_t * const player) {
-    ao_close (player->aoDev);
+    /* flush queued save-file packets before the trailer is written */
+    closeWriteThread (player);
+    /* the audio device stays open for the next song, see openDevice */
     player->aoDev = NULL;
     if (player->fgraph != NULL) {
         avfilter_graph_free (&player->fgraph);
@@ -525,12 +1022,23 @@ void *BarPlayerThread (void *data) {
     intptr_t pret = PLAYER_RET_OK;
     int error;
 
+    pthread_mutex_init (&player->pcmMutex, NULL);
+    pthread_cond_init (&player->pcmNotEmpty, NULL);
+    pthread_cond_init (&player->pcmNotFull, NULL);
+    pthread_mutex_init (&player->writeMutex, NULL);
+    pthread_cond_init (&player->writeCond, NULL);
 
     bool retry;
     do {
         retry = false;
         if (openStream (player)) {
-            if (openFilter (player) && openDevice (player)) {
+            if (player->captureOnly) {
+                /* no filter graph and no audio device needed; if the song
+                 * is already on disk there is nothing to do at all */
+                if (player->save_file) {
+                    retry = play (player) == AVERROR_INVALIDDATA;
+                }
+            } else if (openFilter (player) && openDevice (player)) {
                 retry = play (player) == AVERROR_INVALIDDATA;
             } else {
                 /* filter missing or audio device busy */
@@ -543,17 +1051,33 @@ void *BarPlayerThread (void *data) {
         finish (player);
     } while (retry);
 
+    pthread_cond_destroy (&player->writeCond);
+    pthread_mutex_destroy (&player->writeMutex);
+    pthread_cond_destroy (&player->pcmNotFull);
+    pthread_cond_destroy (&player->pcmNotEmpty);
+    pthread_mutex_destroy (&player->pcmMutex);
+
     player->mode = PLAYER_FINISHED;
 
-    if ( player->save_file && !player->doQuit ){
-    /*if ( save_file ){*/
+    if ( player->save_file ){
+        const bool completed = !player->doQuit;
         char * buffer [2000];
-        av_write_trailer(player->ofcx);
+        if (completed) {
+            av_write_trailer(player->ofcx);
+        }
+        closeSaveFile (player, completed);
         avformat_free_context (player->ofcx);
-        avio_close(player->ofcx->pb);
-        sprintf(buffer, "mv \"%s\" \"%s\"", player->tmp_filename, player->save_complete);
-        system(buffer);
+        if (completed) {
+            sprintf(buffer, "mv \"%s\" \"%s\"", player->tmp_filename, player->save_complete);
+            system(buffer);
+        }
     }
+
+    /* wake the main loop, it may be sleeping on its event pipe */
+    if (player->eventFd > 0) {
+        write (player->eventFd, "", 1);
+    }
+
     return (void *) pret;
 }
 
@@ -41,6 +41,25 @@ THE SOFTWARE.
 #include "settings.h"
 #include "config.h"
 
+/* number of decoded pcm chunks (one avfilter output frame each) buffered
+ * between decoder and audio output; at ~23ms per aac frame this is a few
+ * seconds of decode-ahead */
+#define BAR_PLAYER_PCM_SLOTS 256
+
+/* one decoded pcm chunk */
+typedef struct {
+	char *data;
+	size_t size;
+	/* song position (seconds) after this chunk, for the time display */
+	unsigned int songPlayed;
+} BarPcmChunk_t;
+
+/* cloned packet queued for the save-file writer thread */
+typedef struct BarWritePkt {
+	AVPacket pkt;
+	struct BarWritePkt *next;
+} BarWritePkt_t;
+
 typedef struct {
 	/* protected by pauseMutex */
 	volatile bool doQuit;
@@ -48,6 +67,26 @@ typedef struct {
 	pthread_mutex_t pauseMutex;
 	pthread_cond_t pauseCond;
 
+	/* decode-ahead ring buffer, filled by the decoder (see play()) and
+	 * drained into libao by the playback thread; protected by pcmMutex */
+	BarPcmChunk_t pcmBuf[BAR_PLAYER_PCM_SLOTS];
+	size_t pcmRead, pcmWrite, pcmFill;
+	/* decoder is done, drain buffer and quit */
+	bool pcmDone;
+	pthread_mutex_t pcmMutex;
+	pthread_cond_t pcmNotEmpty, pcmNotFull;
+
+	/* save-file writer thread: remuxed packets are queued here so disk
+	 * latency never stalls the decode/playback path; protected by
+	 * writeMutex */
+	pthread_t writeThread;
+	bool writeThreadStarted;
+	BarWritePkt_t *writeHead, *writeTail;
+	/* decoder is done, flush queue and quit */
+	bool writeDone;
+	pthread_mutex_t writeMutex;
+	pthread_cond_t writeCond;
+
 	enum {
 		PLAYER_DEAD = 0, /* thread is not running */
 		PLAYER_STARTING, /* thread is starting */
@@ -66,6 +105,15 @@ typedef struct {
 	AVFilterContext *fbufsink, *fabuf;
 	int streamIdx;
 	int64_t lastTimestamp;
+	/* byte position in the stream, used to resume an interrupted song with a
+	 * range request instead of re-downloading it, see openStream */
+	int64_t resumeOffset;
+	/* seconds played before the last resume, added to the restarted
+	 * timestamps of the resumed stream */
+	unsigned int resumePlayed;
+	/* write end of the main loop's event pipe (-1 if unused), signalled when
+	 * the thread finished */
+	int eventFd;
 #ifndef HAVE_AV_TIMEOUT
 	int64_t ping;
 #endif
@@ -75,11 +123,27 @@ typedef struct {
 	/* settings */
 	volatile double volume;
 	double gain;
+	/* gain factor applied by the decode thread, see BarPlayerSetVolume */
+	volatile double volumeScale;
+	/* scale/convert decoded frames in place instead of running the filter
+	 * graph, set for the common sample formats */
+	bool directVolume;
 	char *url;
     char *artist;
     char *title;
     char *station;
     bool save_file;
+    /* remux to the save file only, no decoding and no audio output; used by
+     * the recorder contexts, see recorder.c */
+    bool captureOnly;
+    /* save file descriptor behind the buffered avio context, see
+     * openSaveFile */
+    int saveFd;
+    /* current write position and largest offset ever written; the muxer may
+     * seek backwards to patch its header, so only the high-water mark marks
+     * the real end of the data */
+    off_t saveOffset;
+    off_t saveMaxOffset;
     char tmp_filename [1000];
     char save_complete[1000];
 	const BarSettings_t *settings;
@@ -87,6 +151,24 @@ typedef struct {
 	/* measured in seconds */
 	volatile unsigned int songDuration;
 	volatile unsigned int songPlayed;
+
+	/* network statistics, filled by the decode loop and read by the main
+	 * thread after the join, see BarMainAdaptQuality: compressed bytes
+	 * fetched, time (us) spent waiting in av_read_frame and number of reads
+	 * that stalled noticeably */
+	size_t bytesReceived;
+	int64_t readTime;
+	unsigned int readStalls;
+	/* us spent in avcodec_decode_audio4 and frames decoded (decode
+	 * thread); pushes into the pcm ring are excluded, those block on
+	 * playback pacing */
+	int64_t decodeTime;
+	unsigned int decodedFrames;
+	/* us blocked in ao_play, chunks played and times the decode-ahead ring
+	 * ran dry mid-song (playback thread) */
+	int64_t playTime;
+	unsigned int playedChunks;
+	unsigned int underruns;
 } player_t;
 
 enum {PLAYER_RET_OK = 0, PLAYER_RET_HARDFAIL = 1, PLAYER_RET_SOFTFAIL = 2};
@@ -0,0 +1,257 @@
+/*
+Copyright (c) 2008-2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* background recorder: capture several stations at once within the running
+ * session. every recorded station gets one thread that fetches playlists
+ * through the shared (pianoMutex-serialized) api handle and runs the player
+ * in capture-only mode, which remuxes the stream into the save directory
+ * without decoding it or touching the audio device. only the interactive
+ * player plays audio. */
+
+#ifndef __FreeBSD__
+#define _BSD_SOURCE /* strdup() */
+#define _DARWIN_C_SOURCE /* strdup() on OS X */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "recorder.h"
+#include "ui.h"
+
+typedef struct {
+	pthread_t thread;
+	bool running;
+	volatile bool doQuit;
+	BarApp_t *app;
+	/* private copy, independent of the lifetime of the ui's station lists */
+	PianoStation_t station;
+	PianoSong_t *playlist;
+	/* protects player setup/teardown against BarRecorderStop */
+	pthread_mutex_t lock;
+	player_t player;
+} BarRecorderContext_t;
+
+#define BAR_RECORDER_MAX 16
+
+/* only touched by the main thread (start/stop), the contexts themselves by
+ * their capture threads */
+static BarRecorderContext_t recorders[BAR_RECORDER_MAX];
+static size_t recorderCount = 0;
+
+/*	capture one song, blocks until the song is done or the recorder is
+ *	stopped
+ */
+static void BarRecorderCaptureSong (BarRecorderContext_t * const ctx,
+		const PianoSong_t * const song) {
+	static const char httpPrefix[] = "http://";
+
+	if (song->audioUrl == NULL ||
+			strncmp (song->audioUrl, httpPrefix, strlen (httpPrefix)) != 0) {
+		return;
+	}
+
+	pthread_mutex_lock (&ctx->lock);
+	memset (&ctx->player, 0, sizeof (ctx->player));
+	ctx->player.url = song->audioUrl;
+	ctx->player.artist = song->artist;
+	ctx->player.title = song->title;
+	ctx->player.station = ctx->station.name;
+	ctx->player.gain = song->fileGain;
+	ctx->player.settings = &ctx->app->settings;
+	ctx->player.songDuration = song->length;
+	ctx->player.captureOnly = true;
+	pthread_mutex_init (&ctx->player.pauseMutex, NULL);
+	pthread_cond_init (&ctx->player.pauseCond, NULL);
+	ctx->player.doQuit = ctx->doQuit;
+	ctx->player.mode = PLAYER_STARTING;
+	pthread_mutex_unlock (&ctx->lock);
+
+	BarPlayerThread (&ctx->player);
+
+	pthread_mutex_lock (&ctx->lock);
+	pthread_cond_destroy (&ctx->player.pauseCond);
+	pthread_mutex_destroy (&ctx->player.pauseMutex);
+	ctx->player.mode = PLAYER_DEAD;
+	pthread_mutex_unlock (&ctx->lock);
+}
+
+/*	per-station capture loop: fetch playlists and record song by song
+ */
+static void *BarRecorderThread (void *data) {
+	BarRecorderContext_t * const ctx = data;
+	unsigned int errors = 0;
+
+	while (!ctx->doQuit) {
+		if (ctx->playlist == NULL) {
+			PianoReturn_t pRet;
+			WaitressReturn_t wRet;
+			PianoRequestDataGetPlaylist_t reqData;
+			reqData.station = &ctx->station;
+			reqData.quality = ctx->app->settings.audioQuality;
+
+			BarUiMsg (&ctx->app->settings, MSG_INFO,
+					"Recorder: playlist for \"%s\"... ", ctx->station.name);
+			if (!BarUiPianoCall (ctx->app, PIANO_REQUEST_GET_PLAYLIST,
+					&reqData, &pRet, &wRet) || reqData.retPlaylist == NULL) {
+				if (++errors >= ctx->app->settings.maxPlayerErrors) {
+					BarUiMsg (&ctx->app->settings, MSG_ERR,
+							"Recorder: giving up on \"%s\".\n",
+							ctx->station.name);
+					break;
+				}
+				/* transient failure, try again with the next fetch */
+				sleep (5);
+				continue;
+			}
+			errors = 0;
+			ctx->playlist = reqData.retPlaylist;
+		}
+
+		PianoSong_t * const song = ctx->playlist;
+		ctx->playlist = PianoListNextP (ctx->playlist);
+		song->head.next = NULL;
+
+		BarRecorderCaptureSong (ctx, song);
+
+		PianoDestroyPlaylist (song);
+	}
+
+	PianoDestroyPlaylist (ctx->playlist);
+	ctx->playlist = NULL;
+
+	return NULL;
+}
+
+/*	start one capture context for the given station
+ */
+static void BarRecorderStartStation (BarApp_t * const app,
+		const PianoStation_t * const station) {
+	if (recorderCount >= BAR_RECORDER_MAX) {
+		BarUiMsg (&app->settings, MSG_ERR,
+				"Recorder: too many stations, skipping \"%s\".\n",
+				station->name);
+		return;
+	}
+
+	BarRecorderContext_t * const ctx = &recorders[recorderCount];
+	memset (ctx, 0, sizeof (*ctx));
+	ctx->app = app;
+	/* private station copy, playlist requests only need id and name */
+	ctx->station.id = strdup (station->id);
+	ctx->station.name = strdup (station->name);
+	ctx->station.isQuickMix = station->isQuickMix;
+	pthread_mutex_init (&ctx->lock, NULL);
+
+	if (pthread_create (&ctx->thread, NULL, BarRecorderThread, ctx) != 0) {
+		BarUiMsg (&app->settings, MSG_ERR, "Recorder: cannot start thread.\n");
+		free (ctx->station.id);
+		free (ctx->station.name);
+		pthread_mutex_destroy (&ctx->lock);
+		return;
+	}
+	ctx->running = true;
+	++recorderCount;
+
+	BarUiMsg (&app->settings, MSG_INFO, "Recording station \"%s\".\n",
+			station->name);
+}
+
+/*	start capture threads for all stations listed in recorder_stations
+ *	(comma-separated names); requires save_dir and a loaded station list
+ */
+void BarRecorderStart (BarApp_t *app) {
+	assert (app != NULL);
+
+	if (app->settings.recorderStations == NULL) {
+		return;
+	}
+	if (app->settings.save_dir == NULL) {
+		BarUiMsg (&app->settings, MSG_ERR,
+				"Recorder: save_dir is not set.\n");
+		return;
+	}
+
+	PianoStation_t * const stations = BarUiStations (app);
+	char * const names = strdup (app->settings.recorderStations);
+	char *curName = names;
+
+	while (curName != NULL) {
+		char * const comma = strchr (curName, ',');
+		if (comma != NULL) {
+			*comma = '\0';
+		}
+
+		PianoStation_t *curStation = stations;
+		PianoListForeachP (curStation) {
+			if (strcasecmp (curStation->name, curName) == 0) {
+				break;
+			}
+		}
+		if (curStation != NULL) {
+			BarRecorderStartStation (app, curStation);
+		} else {
+			BarUiMsg (&app->settings, MSG_ERR,
+					"Recorder: station \"%s\" not found.\n", curName);
+		}
+
+		curName = comma != NULL ? comma + 1 : NULL;
+	}
+
+	free (names);
+}
+
+/*	stop and join all capture threads
+ */
+void BarRecorderStop (void) {
+	for (size_t i = 0; i < recorderCount; i++) {
+		BarRecorderContext_t * const ctx = &recorders[i];
+
+		pthread_mutex_lock (&ctx->lock);
+		ctx->doQuit = true;
+		if (ctx->player.mode != PLAYER_DEAD) {
+			pthread_mutex_lock (&ctx->player.pauseMutex);
+			ctx->player.doQuit = true;
+			pthread_cond_broadcast (&ctx->player.pauseCond);
+			pthread_mutex_unlock (&ctx->player.pauseMutex);
+		}
+		pthread_mutex_unlock (&ctx->lock);
+	}
+
+	for (size_t i = 0; i < recorderCount; i++) {
+		BarRecorderContext_t * const ctx = &recorders[i];
+
+		if (ctx->running) {
+			pthread_join (ctx->thread, NULL);
+			ctx->running = false;
+		}
+		free (ctx->station.id);
+		free (ctx->station.name);
+		pthread_mutex_destroy (&ctx->lock);
+	}
+	recorderCount = 0;
+}
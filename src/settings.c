@@ -34,7 +34,12 @@ THE SOFTWARE.
 #include <stdio.h>
 #include <limits.h>
 #include <assert.h>
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <pwd.h>
 
 #include <piano.h>
@@ -118,6 +123,7 @@ void BarSettingsDestroy (BarSettings_t *settings) {
 	free (settings->passwordCmd);
 	free (settings->autostartStation);
 	free (settings->eventCmd);
+	free (settings->recorderStations);
 	free (settings->loveIcon);
 	free (settings->banIcon);
 	free (settings->atIcon);
@@ -158,11 +164,13 @@ void BarSettingsRead (BarSettings_t *settings) {
 
 	/* apply defaults */
 	settings->audioQuality = PIANO_AQ_HIGH;
+	settings->adaptiveQuality = true;
 	settings->autoselect = true;
     settings->save_dir = NULL;
 	settings->history = 5;
 	settings->volume = 0;
 	settings->maxPlayerErrors = 5;
+	settings->saveWriteBuffer = 1024 * 1024;
 	settings->sortOrder = BAR_SORT_NAME_AZ;
 	settings->loveIcon = strdup (" <3");
 	settings->banIcon = strdup (" </3");
@@ -279,15 +287,26 @@ void BarSettingsRead (BarSettings_t *settings) {
 				} else if (streq (val, "high")) {
 					settings->audioQuality = PIANO_AQ_HIGH;
 				}
+			} else if (streq ("adaptive_quality", key)) {
+				settings->adaptiveQuality = atoi (val);
 			} else if (streq ("autostart_station", key)) {
 				free (settings->autostartStation);
 				settings->autostartStation = strdup (val);
 			} else if (streq ("event_command", key)) {
 				settings->eventCmd = strdup (val);
+			} else if (streq ("event_command_daemon", key)) {
+				settings->eventCmdDaemon = atoi (val);
+			} else if (streq ("recorder_stations", key)) {
+				free (settings->recorderStations);
+				settings->recorderStations = strdup (val);
 			} else if (streq ("history", key)) {
 				settings->history = atoi (val);
 			} else if (streq ("max_player_errors", key)) {
 				settings->maxPlayerErrors = atoi (val);
+			} else if (streq ("save_write_buffer", key)) {
+				if (atoi (val) > 0) {
+					settings->saveWriteBuffer = atoi (val);
+				}
 			} else if (streq ("sort", key)) {
 				size_t i;
 				static const char *mapping[] = {"name_az",
@@ -383,9 +402,31 @@ void BarSettingsRead (BarSettings_t *settings) {
 		}
 	}
 
+	BarSettingsBuildKeyMap (settings);
+
 	free (userhome);
 }
 
+/*	build the direct-index key dispatch map: for every key the id of the
+ *	first action bound to it, BAR_KS_COUNT if unbound. turns keystroke
+ *	dispatch into a single array lookup, see BarUiDispatch. must be rebuilt
+ *	whenever keys changes.
+ *	@param settings
+ */
+void BarSettingsBuildKeyMap (BarSettings_t *settings) {
+	assert (settings != NULL);
+
+	memset (settings->keyMap, BAR_KS_COUNT, sizeof (settings->keyMap));
+	/* walk backwards so the first of several actions bound to the same key
+	 * wins, like the previous linear scan did */
+	for (size_t i = BAR_KS_COUNT; i > 0; i--) {
+		const unsigned char key = (unsigned char) settings->keys[i-1];
+		if (key != BAR_KS_DISABLED) {
+			settings->keyMap[key] = i-1;
+		}
+	}
+}
+
 /*	write statefile
  */
 void BarSettingsWrite (PianoStation_t *station, BarSettings_t *settings) {
@@ -410,3 +451,175 @@ void BarSettingsWrite (PianoStation_t *station, BarSettings_t *settings) {
 	free (path);
 }
 
+/* station list cache: header, then one record per station (flags byte,
+ * name/id length, both strings without trailing NUL) */
+#define BAR_STATION_CACHE_MAGIC 0x43534250 /* "PBSC" */
+#define BAR_STATION_CACHE_VERSION 1
+#define BAR_STATION_CACHE_CREATOR (1 << 0)
+#define BAR_STATION_CACHE_QUICKMIX (1 << 1)
+#define BAR_STATION_CACHE_USEQUICKMIX (1 << 2)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+} BarStationCacheHeader_t;
+
+/*	copy a non-terminated string from the cache mapping
+ */
+static char *BarStationCacheStrdup (const char * const s, const size_t len) {
+	char * const ret = malloc (len + 1);
+
+	if (ret != NULL) {
+		memcpy (ret, s, len);
+		ret[len] = '\0';
+	}
+
+	return ret;
+}
+
+/*	read station list cache; the file is mmap'ed and parsed in place, so
+ *	startup does not pay for buffering the whole file. returns NULL if there
+ *	is no (usable) cache
+ */
+PianoStation_t *BarStationCacheRead (void) {
+	char * const path = BarGetXdgConfigDir (PACKAGE "/stations");
+	if (path == NULL) {
+		return NULL;
+	}
+
+	const int fd = open (path, O_RDONLY);
+	free (path);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat (fd, &st) == -1 ||
+			(size_t) st.st_size < sizeof (BarStationCacheHeader_t)) {
+		close (fd);
+		return NULL;
+	}
+	const size_t size = st.st_size;
+
+	char * const map = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* mapping may be unaligned, copy header/lengths out */
+	BarStationCacheHeader_t header;
+	memcpy (&header, map, sizeof (header));
+	if (header.magic != BAR_STATION_CACHE_MAGIC ||
+			header.version != BAR_STATION_CACHE_VERSION) {
+		munmap (map, size);
+		return NULL;
+	}
+
+	PianoList_t stations;
+	PianoListInit (&stations, NULL);
+	size_t pos = sizeof (header);
+	bool ok = true;
+
+	for (uint32_t i = 0; i < header.count && ok; i++) {
+		uint8_t flags;
+		uint16_t nameLen, idLen;
+
+		if (pos + sizeof (flags) + sizeof (nameLen) + sizeof (idLen) > size) {
+			ok = false;
+			break;
+		}
+		memcpy (&flags, &map[pos], sizeof (flags));
+		pos += sizeof (flags);
+		memcpy (&nameLen, &map[pos], sizeof (nameLen));
+		pos += sizeof (nameLen);
+		memcpy (&idLen, &map[pos], sizeof (idLen));
+		pos += sizeof (idLen);
+
+		if (pos + nameLen + idLen > size) {
+			ok = false;
+			break;
+		}
+
+		PianoStation_t *station;
+		if ((station = calloc (1, sizeof (*station))) == NULL) {
+			ok = false;
+			break;
+		}
+		station->name = BarStationCacheStrdup (&map[pos], nameLen);
+		pos += nameLen;
+		station->id = BarStationCacheStrdup (&map[pos], idLen);
+		pos += idLen;
+		station->isCreator = !!(flags & BAR_STATION_CACHE_CREATOR);
+		station->isQuickMix = !!(flags & BAR_STATION_CACHE_QUICKMIX);
+		station->useQuickMix = !!(flags & BAR_STATION_CACHE_USEQUICKMIX);
+		if (station->name == NULL || station->id == NULL) {
+			free (station->name);
+			free (station->id);
+			free (station);
+			ok = false;
+			break;
+		}
+
+		PianoListPushP (&stations, station);
+	}
+
+	munmap (map, size);
+
+	if (!ok) {
+		PianoDestroyStations (PianoListHeadP (&stations));
+		return NULL;
+	}
+
+	return PianoListHeadP (&stations);
+}
+
+/*	write station list cache, see BarStationCacheRead for the format
+ */
+void BarStationCacheWrite (const PianoStation_t *stations) {
+	char * const path = BarGetXdgConfigDir (PACKAGE "/stations");
+	if (path == NULL) {
+		return;
+	}
+
+	FILE * const fd = fopen (path, "w");
+	free (path);
+	if (fd == NULL) {
+		return;
+	}
+
+	BarStationCacheHeader_t header = {
+			.magic = BAR_STATION_CACHE_MAGIC,
+			.version = BAR_STATION_CACHE_VERSION,
+			.count = 0,
+			};
+	const PianoStation_t *curStation = stations;
+	PianoListForeachP (curStation) {
+		if (curStation->name != NULL && curStation->id != NULL) {
+			++header.count;
+		}
+	}
+	fwrite (&header, sizeof (header), 1, fd);
+
+	curStation = stations;
+	PianoListForeachP (curStation) {
+		if (curStation->name == NULL || curStation->id == NULL) {
+			continue;
+		}
+		const uint8_t flags =
+				(curStation->isCreator ? BAR_STATION_CACHE_CREATOR : 0) |
+				(curStation->isQuickMix ? BAR_STATION_CACHE_QUICKMIX : 0) |
+				(curStation->useQuickMix ? BAR_STATION_CACHE_USEQUICKMIX : 0);
+		const uint16_t nameLen = strlen (curStation->name),
+				idLen = strlen (curStation->id);
+		fwrite (&flags, sizeof (flags), 1, fd);
+		fwrite (&nameLen, sizeof (nameLen), 1, fd);
+		fwrite (&idLen, sizeof (idLen), 1, fd);
+		fwrite (curStation->name, 1, nameLen, fd);
+		fwrite (curStation->id, 1, idLen, fd);
+	}
+
+	fclose (fd);
+}
+
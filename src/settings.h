@@ -60,8 +60,9 @@ typedef enum {
 	BAR_KS_PLAY = 26,
 	BAR_KS_PAUSE = 27,
 	BAR_KS_VOLRESET = 28,
+	BAR_KS_STATS = 29,
 	/* insert new shortcuts _before_ this element and increase its value */
-	BAR_KS_COUNT = 29,
+	BAR_KS_COUNT = 30,
 } BarKeyShortcutId_t;
 
 #define BAR_KS_DISABLED '\x00'
@@ -86,9 +87,15 @@ typedef struct {
 typedef struct {
 	bool autoselect;
 	unsigned int history, maxPlayerErrors;
+	/* size (bytes) of the coalescing write buffer for saved songs, see
+	 * openSaveFile in player.c */
+	unsigned int saveWriteBuffer;
 	int volume;
 	BarStationSorting_t sortOrder;
 	PianoAudioQuality_t audioQuality;
+	/* pick the quality tier from measured throughput, audioQuality is the
+	 * upper bound then, see BarMainAdaptQuality */
+	bool adaptiveQuality;
 	char *username;
 	char *password, *passwordCmd;
 	char *controlProxy; /* non-american listeners need this */
@@ -96,6 +103,11 @@ typedef struct {
 	char *autostartStation;
 	char *save_dir;
 	char *eventCmd;
+	/* run eventCmd as a long-lived coprocess, see BarUiStartEventCmd */
+	bool eventCmdDaemon;
+	/* comma-separated names of stations captured in the background, see
+	 * recorder.c */
+	char *recorderStations;
 	char *loveIcon;
 	char *banIcon;
 	char *atIcon;
@@ -106,6 +118,9 @@ typedef struct {
 	char *rpcHost, *rpcTlsPort, *partnerUser, *partnerPassword, *device, *inkey, *outkey;
 	char tlsFingerprint[20];
 	char keys[BAR_KS_COUNT];
+	/* key char -> id of the first action bound to it (BAR_KS_COUNT if
+	 * unbound), see BarSettingsBuildKeyMap */
+	unsigned char keyMap[256];
 	BarMsgFormatStr_t msgFormat[MSG_COUNT];
 } BarSettings_t;
 
@@ -114,6 +129,9 @@ typedef struct {
 void BarSettingsInit (BarSettings_t *);
 void BarSettingsDestroy (BarSettings_t *);
 void BarSettingsRead (BarSettings_t *);
+void BarSettingsBuildKeyMap (BarSettings_t *);
 void BarSettingsWrite (PianoStation_t *, BarSettings_t *);
+PianoStation_t *BarStationCacheRead (void);
+void BarStationCacheWrite (const PianoStation_t *);
 
 #endif /* SRC_SETTINGS_H_IPL0ON9L */
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2008-2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/* session-wide performance counters, see stats.h */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "stats.h"
+#include "ui.h"
+
+BarStats_t barStats;
+
+/* histogram bucket upper bounds (ms), last bucket is open-ended */
+static const unsigned int latencyBucketMs[BAR_STATS_LAT_BUCKETS] =
+		{10, 30, 100, 300, 1000, 3000, 10000, 0};
+
+/*	fold one song's player counters into the session totals; called by the
+ *	main thread after the player thread has been joined
+ */
+void BarStatsAddSong (const player_t *player) {
+	++barStats.songsPlayed;
+	barStats.readTime += player->readTime;
+	barStats.readStalls += player->readStalls;
+	barStats.bytesReceived += player->bytesReceived;
+	barStats.decodeTime += player->decodeTime;
+	barStats.decodedFrames += player->decodedFrames;
+	barStats.playTime += player->playTime;
+	barStats.playedChunks += player->playedChunks;
+	barStats.underruns += player->underruns;
+}
+
+/*	record one api request's wall-clock latency; only ever called with
+ *	pianoMutex held (see BarUiPianoCall), so plain counters suffice
+ */
+void BarStatsRecordApi (uint64_t us) {
+	size_t bucket;
+	const uint64_t ms = us / 1000;
+
+	++barStats.apiRequests;
+	barStats.apiTime += us;
+	if (us > barStats.apiMaxTime) {
+		barStats.apiMaxTime = us;
+	}
+
+	for (bucket = 0; bucket < BAR_STATS_LAT_BUCKETS - 1; bucket++) {
+		if (ms < latencyBucketMs[bucket]) {
+			break;
+		}
+	}
+	++barStats.apiLatency[bucket];
+}
+
+/*	average (us -> ms) guarding against division by zero
+ */
+static double BarStatsAvgMs (uint64_t timeUs, uint64_t count) {
+	return count > 0 ? (double) timeUs / count / 1000.0 : 0.0;
+}
+
+/*	print a snapshot of the collected counters
+ */
+void BarStatsDump (const BarSettings_t *settings) {
+	BarUiMsg (settings, MSG_INFO, "%" PRIu64 " songs, %" PRIu64
+			" KiB received, %" PRIu64 " read stalls, %" PRIu64
+			" underruns\n", barStats.songsPlayed,
+			barStats.bytesReceived / 1024, barStats.readStalls,
+			barStats.underruns);
+	BarUiMsg (settings, MSG_INFO, "network wait %.1f s, decode "
+			"%.2f ms/frame, ao_play %.2f ms/chunk\n",
+			(double) barStats.readTime / 1000000.0,
+			BarStatsAvgMs (barStats.decodeTime, barStats.decodedFrames),
+			BarStatsAvgMs (barStats.playTime, barStats.playedChunks));
+	BarUiMsg (settings, MSG_INFO, "%" PRIu64 " api requests, avg %.0f ms, "
+			"max %.0f ms\n", barStats.apiRequests,
+			BarStatsAvgMs (barStats.apiTime, barStats.apiRequests),
+			(double) barStats.apiMaxTime / 1000.0);
+	for (size_t i = 0; i < BAR_STATS_LAT_BUCKETS; i++) {
+		if (barStats.apiLatency[i] == 0) {
+			continue;
+		}
+		if (latencyBucketMs[i] > 0) {
+			BarUiMsg (settings, MSG_INFO, "  < %u ms: %" PRIu64 "\n",
+					latencyBucketMs[i], barStats.apiLatency[i]);
+		} else {
+			BarUiMsg (settings, MSG_INFO, "  >= %u ms: %" PRIu64 "\n",
+					latencyBucketMs[i - 1], barStats.apiLatency[i]);
+		}
+	}
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2008-2014
+	Lars-Dominik Braun <lars@6xq.net>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SRC_STATS_H_W7GJ2XQ4
+#define SRC_STATS_H_W7GJ2XQ4
+
+#include <stdint.h>
+
+#include "player.h"
+#include "settings.h"
+
+/* api latency histogram buckets, see latencyBucketMs in stats.c */
+#define BAR_STATS_LAT_BUCKETS 8
+
+/*	session-wide performance counters. the hot paths only bump plain
+ *	per-thread counters in player_t; they are folded in here by the main
+ *	thread after the player join, so no locks are needed anywhere
+ */
+typedef struct {
+	/* decode/playback, see BarStatsAddSong */
+	uint64_t songsPlayed;
+	/* us spent waiting in av_read_frame and reads that stalled */
+	uint64_t readTime;
+	uint64_t readStalls;
+	uint64_t bytesReceived;
+	/* us spent in avcodec_decode_audio4 */
+	uint64_t decodeTime;
+	uint64_t decodedFrames;
+	/* us blocked in ao_play */
+	uint64_t playTime;
+	uint64_t playedChunks;
+	/* the playback thread drained the decode-ahead ring mid-song */
+	uint64_t underruns;
+	/* piano api requests, see BarStatsRecordApi */
+	uint64_t apiRequests;
+	uint64_t apiTime;
+	uint64_t apiMaxTime;
+	uint64_t apiLatency[BAR_STATS_LAT_BUCKETS];
+} BarStats_t;
+
+extern BarStats_t barStats;
+
+void BarStatsAddSong (const player_t *player);
+void BarStatsRecordApi (uint64_t us);
+void BarStatsDump (const BarSettings_t *settings);
+
+#endif /* SRC_STATS_H_W7GJ2XQ4 */
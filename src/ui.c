@@ -38,13 +38,17 @@ THE SOFTWARE.
 #include <strings.h>
 #include <assert.h>
 #include <ctype.h> /* tolower() */
+#include <pthread.h>
+#include <signal.h>
 
 /* waitpid () */
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 
 #include "ui.h"
 #include "ui_readline.h"
+#include "stats.h"
 
 typedef int (*BarSortFunc_t) (const void *, const void *);
 
@@ -131,6 +135,21 @@ void BarUiMsg (const BarSettings_t *settings, const BarUiMsg_t type,
 	fflush (stdout);
 }
 
+/*	feed response chunks into libpiano's streaming json parser
+ *	@param received data
+ *	@param data size
+ *	@param piano request
+ */
+static WaitressCbReturn_t BarPianoResponseCb (void *recvData,
+		size_t recvDataSize, void *extraData) {
+	PianoRequest_t * const req = extraData;
+
+	if (PianoResponseFeed (req, recvData, recvDataSize) != PIANO_RET_OK) {
+		return WAITRESS_CB_RET_ERR;
+	}
+	return WAITRESS_CB_RET_OK;
+}
+
 /*	fetch http resource (post request)
  *	@param waitress handle
  *	@param piano request (initialized by PianoRequest())
@@ -143,7 +162,11 @@ static WaitressReturn_t BarPianoHttpRequest (WaitressHandle_t *waith,
 	waith->url.path = req->urlPath;
 	waith->url.tls = req->secure;
 
-	return WaitressFetchBuf (waith, &req->responseData);
+	/* the response is parsed while it downloads, no intermediate buffer */
+	waith->data = req;
+	waith->callback = BarPianoResponseCb;
+
+	return WaitressFetchCall (waith);
 }
 
 /*	piano wrapper: prepare/execute http request and pass result back to
@@ -155,7 +178,7 @@ static WaitressReturn_t BarPianoHttpRequest (WaitressHandle_t *waith,
  *	@param stores waitress return code
  *	@return 1 on success, 0 otherwise
  */
-int BarUiPianoCall (BarApp_t * const app, PianoRequestType_t type,
+static int BarUiPianoCallUnlocked (BarApp_t * const app, PianoRequestType_t type,
 		void *data, PianoReturn_t *pRet, WaitressReturn_t *wRet) {
 	PianoRequest_t req;
 
@@ -196,8 +219,8 @@ int BarUiPianoCall (BarApp_t * const app, PianoRequestType_t type,
 				reqData.step = 0;
 
 				BarUiMsg (&app->settings, MSG_NONE, "Reauthentication required... ");
-				if (!BarUiPianoCall (app, PIANO_REQUEST_LOGIN, &reqData, &authpRet,
-						&authwRet)) {
+				if (!BarUiPianoCallUnlocked (app, PIANO_REQUEST_LOGIN, &reqData,
+						&authpRet, &authwRet)) {
 					*pRet = authpRet;
 					*wRet = authwRet;
 					if (req.responseData != NULL) {
@@ -233,6 +256,44 @@ int BarUiPianoCall (BarApp_t * const app, PianoRequestType_t type,
 	return 1;
 }
 
+/*	serialize piano/waitress access, the playlist prefetch thread (see
+ *	src/main.c) shares both handles with the main thread
+ */
+int BarUiPianoCall (BarApp_t * const app, PianoRequestType_t type,
+		void *data, PianoReturn_t *pRet, WaitressReturn_t *wRet) {
+	struct timeval start, end;
+
+	pthread_mutex_lock (&app->pianoMutex);
+	gettimeofday (&start, NULL);
+	const int ret = BarUiPianoCallUnlocked (app, type, data, pRet, wRet);
+	gettimeofday (&end, NULL);
+	/* still holding pianoMutex, the stats counters need no extra lock */
+	BarStatsRecordApi ((uint64_t) (end.tv_sec - start.tv_sec) * 1000000 +
+			(end.tv_usec - start.tv_usec));
+	pthread_mutex_unlock (&app->pianoMutex);
+	return ret;
+}
+
+/*	station list the ui should work from: the fresh list once it has been
+ *	fetched, the on-disk cache before that. while the refresh thread is
+ *	still running it publishes ph.stations under pianoMutex, so the read
+ *	must take the mutex too; afterwards the list is only touched by the
+ *	main thread
+ */
+PianoStation_t *BarUiStations (BarApp_t * const app) {
+	PianoStation_t *stations;
+
+	if (app->stationRefreshRunning) {
+		pthread_mutex_lock (&app->pianoMutex);
+		stations = app->ph.stations;
+		pthread_mutex_unlock (&app->pianoMutex);
+	} else {
+		stations = app->ph.stations;
+	}
+
+	return stations != NULL ? stations : app->cachedStations;
+}
+
 /*	Station sorting functions */
 
 static inline int BarStationQuickmix01Cmp (const void *a, const void *b) {
@@ -322,6 +383,111 @@ static PianoStation_t **BarSortedStations (PianoStation_t *unsortedStations,
 	return stationArray;
 }
 
+/*	persistent station index: the sorted array and case-folded names are
+ *	built once and reused across selections until the station list itself
+ *	changes. libpiano replaces the whole list on every station add/delete,
+ *	so the index is validated against a pointer snapshot of the list (the
+ *	snapshot is never dereferenced, a stale index is detected safely) and
+ *	rebuilt on mismatch.
+ */
+typedef struct {
+	PianoStation_t *head;
+	BarStationSorting_t order;
+	size_t count;
+	/* sorted station pointers and their case-folded names */
+	PianoStation_t **sorted;
+	char **folded;
+	/* station and name pointers in list order, for validation only */
+	PianoStation_t **listSnap;
+	const char **nameSnap;
+} BarStationIndex_t;
+
+static BarStationIndex_t stationIndex;
+
+/*	malloc'ed lowercase copy
+ */
+static char *BarStrFold (const char *in) {
+	char *out = strdup (in);
+	assert (out != NULL);
+
+	for (char *pos = out; *pos != '\0'; pos++) {
+		*pos = tolower ((unsigned char) *pos);
+	}
+	return out;
+}
+
+/*	free the cached station index
+ */
+void BarUiDestroyStationIndex (void) {
+	for (size_t i = 0; i < stationIndex.count; i++) {
+		free (stationIndex.folded[i]);
+	}
+	free (stationIndex.sorted);
+	free (stationIndex.folded);
+	free (stationIndex.listSnap);
+	free (stationIndex.nameSnap);
+	memset (&stationIndex, 0, sizeof (stationIndex));
+}
+
+/*	does the cached index still describe this station list?
+ */
+static bool BarStationIndexValid (PianoStation_t *stations,
+		BarStationSorting_t order) {
+	size_t i = 0;
+	PianoStation_t *currStation = stations;
+
+	if (stationIndex.sorted == NULL || stationIndex.head != stations ||
+			stationIndex.order != order) {
+		return false;
+	}
+
+	PianoListForeachP (currStation) {
+		if (i >= stationIndex.count ||
+				stationIndex.listSnap[i] != currStation ||
+				stationIndex.nameSnap[i] != currStation->name) {
+			return false;
+		}
+		++i;
+	}
+	return i == stationIndex.count;
+}
+
+/*	(re)build the station index
+ */
+static void BarStationIndexBuild (PianoStation_t *stations,
+		BarStationSorting_t order) {
+	size_t i;
+	PianoStation_t *currStation;
+
+	BarUiDestroyStationIndex ();
+
+	stationIndex.sorted = BarSortedStations (stations, &stationIndex.count,
+			order);
+	stationIndex.folded = calloc (stationIndex.count,
+			sizeof (*stationIndex.folded));
+	stationIndex.listSnap = calloc (stationIndex.count,
+			sizeof (*stationIndex.listSnap));
+	stationIndex.nameSnap = calloc (stationIndex.count,
+			sizeof (*stationIndex.nameSnap));
+	assert (stationIndex.folded != NULL && stationIndex.listSnap != NULL &&
+			stationIndex.nameSnap != NULL);
+
+	for (i = 0; i < stationIndex.count; i++) {
+		stationIndex.folded[i] = BarStrFold (stationIndex.sorted[i]->name);
+	}
+
+	i = 0;
+	currStation = stations;
+	PianoListForeachP (currStation) {
+		stationIndex.listSnap[i] = currStation;
+		stationIndex.nameSnap[i] = currStation->name;
+		++i;
+	}
+
+	stationIndex.head = stations;
+	stationIndex.order = order;
+}
+
 /*	let user pick one station
  *	@param app handle
  *	@param stations that should be listed
@@ -335,7 +501,8 @@ PianoStation_t *BarUiSelectStation (BarApp_t *app, PianoStation_t *stations,
 		bool autoselect) {
 	PianoStation_t **sortedStations = NULL, *retStation = NULL;
 	size_t stationCount, i, lastDisplayed, displayCount;
-	char buf[100];
+	size_t *candidates = NULL, candidateCount;
+	char buf[100], filter[100], prevFilter[100];
 
 	if (stations == NULL) {
 		BarUiMsg (&app->settings, MSG_ERR, "No station available.\n");
@@ -343,27 +510,62 @@ PianoStation_t *BarUiSelectStation (BarApp_t *app, PianoStation_t *stations,
 	}
 
 	memset (buf, 0, sizeof (buf));
+	memset (prevFilter, 0, sizeof (prevFilter));
 
-	/* sort and print stations */
-	sortedStations = BarSortedStations (stations, &stationCount,
-			app->settings.sortOrder);
+	if (!BarStationIndexValid (stations, app->settings.sortOrder)) {
+		BarStationIndexBuild (stations, app->settings.sortOrder);
+	}
+	sortedStations = stationIndex.sorted;
+	stationCount = stationIndex.count;
+
+	/* everything matches the empty filter */
+	candidates = malloc (stationCount * sizeof (*candidates));
+	assert (candidates != NULL);
+	candidateCount = stationCount;
+	for (i = 0; i < stationCount; i++) {
+		candidates[i] = i;
+	}
 
 	do {
-		displayCount = 0;
-		for (i = 0; i < stationCount; i++) {
-			const PianoStation_t *currStation = sortedStations[i];
-			/* filter stations */
-			if (BarStrCaseStr (currStation->name, buf) != NULL) {
-				BarUiMsg (&app->settings, MSG_LIST, "%2zi) %c%c%c %s\n", i,
-						currStation->useQuickMix ? 'q' : ' ',
-						currStation->isQuickMix ? 'Q' : ' ',
-						!currStation->isCreator ? 'S' : ' ',
-						currStation->name);
-				++displayCount;
-				lastDisplayed = i;
+		/* fold the filter once, the indexed names are folded already */
+		for (i = 0; i < sizeof (filter); i++) {
+			filter[i] = tolower ((unsigned char) buf[i]);
+			if (buf[i] == '\0') {
+				break;
+			}
+		}
+
+		if (strncmp (filter, prevFilter, strlen (prevFilter)) != 0) {
+			/* not an extension of the previous filter, start over */
+			candidateCount = stationCount;
+			for (i = 0; i < stationCount; i++) {
+				candidates[i] = i;
 			}
 		}
 
+		/* narrow the previous result set instead of rescanning all
+		 * stations */
+		size_t kept = 0;
+		for (i = 0; i < candidateCount; i++) {
+			if (strstr (stationIndex.folded[candidates[i]], filter) != NULL) {
+				candidates[kept++] = candidates[i];
+			}
+		}
+		candidateCount = kept;
+		strcpy (prevFilter, filter);
+
+		displayCount = candidateCount;
+		for (i = 0; i < candidateCount; i++) {
+			const PianoStation_t *currStation = sortedStations[candidates[i]];
+			BarUiMsg (&app->settings, MSG_LIST, "%2zi) %c%c%c %s\n",
+					candidates[i],
+					currStation->useQuickMix ? 'q' : ' ',
+					currStation->isQuickMix ? 'Q' : ' ',
+					!currStation->isCreator ? 'S' : ' ',
+					currStation->name);
+			lastDisplayed = candidates[i];
+		}
+
 		BarUiMsg (&app->settings, MSG_QUESTION, "%s", prompt);
 		if (autoselect && displayCount == 1 && stationCount != 1) {
 			/* auto-select last remaining station */
@@ -385,11 +587,28 @@ PianoStation_t *BarUiSelectStation (BarApp_t *app, PianoStation_t *stations,
 			/* hand over buffer to external function if it was not a station number */
 			if (retStation == NULL && callback != NULL) {
 				callback (app, buf);
+				if (!BarStationIndexValid (stations,
+						app->settings.sortOrder)) {
+					/* callback changed the station list (it cannot move the
+					 * head, that is owned by the caller), reindex */
+					BarStationIndexBuild (stations, app->settings.sortOrder);
+					sortedStations = stationIndex.sorted;
+					stationCount = stationIndex.count;
+					free (candidates);
+					candidates = malloc (stationCount *
+							sizeof (*candidates));
+					assert (candidates != NULL);
+					candidateCount = stationCount;
+					for (i = 0; i < stationCount; i++) {
+						candidates[i] = i;
+					}
+					prevFilter[0] = '\0';
+				}
 			}
 		}
 	} while (retStation == NULL);
 
-	free (sortedStations);
+	free (candidates);
 	return retStation;
 }
 
@@ -674,6 +893,142 @@ size_t BarUiListSongs (const BarSettings_t *settings,
 	return i;
 }
 
+/*	write one event's key-value payload
+ *	@param write end of the eventcmd pipe
+ *	@param settings
+ *	@param current station
+ *	@param current song
+ *	@param player handle
+ *	@param linked list of all stations
+ *	@param piano error-code (PIANO_RET_OK if not applicable)
+ *	@param waitress error-code (WAITRESS_RET_OK if not applicable)
+ */
+static void BarUiEventCmdPayload (FILE *pipeWriteFd,
+		const BarSettings_t *settings, const PianoStation_t *curStation,
+		const PianoSong_t *curSong, const player_t * const player,
+		PianoStation_t *stations, PianoReturn_t pRet, WaitressReturn_t wRet) {
+	PianoStation_t *songStation = NULL;
+
+	if (curSong != NULL && stations != NULL && curStation->isQuickMix) {
+		songStation = PianoFindStationById (stations, curSong->stationId);
+	}
+
+	fprintf (pipeWriteFd,
+			"artist=%s\n"
+			"title=%s\n"
+			"album=%s\n"
+			"coverArt=%s\n"
+			"stationName=%s\n"
+			"songStationName=%s\n"
+			"pRet=%i\n"
+			"pRetStr=%s\n"
+			"wRet=%i\n"
+			"wRetStr=%s\n"
+			"songDuration=%u\n"
+			"songPlayed=%u\n"
+			"rating=%i\n"
+			"detailUrl=%s\n",
+			curSong == NULL ? "" : curSong->artist,
+			curSong == NULL ? "" : curSong->title,
+			curSong == NULL ? "" : curSong->album,
+			curSong == NULL ? "" : curSong->coverArt,
+			curStation == NULL ? "" : curStation->name,
+			songStation == NULL ? "" : songStation->name,
+			pRet,
+			PianoErrorToStr (pRet),
+			wRet,
+			WaitressErrorToStr (wRet),
+			player->songDuration,
+			player->songPlayed,
+			curSong == NULL ? PIANO_RATE_NONE : curSong->rating,
+			curSong == NULL ? "" : curSong->detailUrl
+			);
+
+	if (stations != NULL) {
+		/* send station list */
+		PianoStation_t **sortedStations = NULL;
+		size_t stationCount;
+		sortedStations = BarSortedStations (stations, &stationCount,
+				settings->sortOrder);
+		assert (sortedStations != NULL);
+
+		fprintf (pipeWriteFd, "stationCount=%zd\n", stationCount);
+
+		for (size_t i = 0; i < stationCount; i++) {
+			const PianoStation_t *currStation = sortedStations[i];
+			fprintf (pipeWriteFd, "station%zd=%s\n", i,
+					currStation->name);
+		}
+		free (sortedStations);
+	} else {
+		const char * const msg = "stationCount=0\n";
+		fwrite (msg, sizeof (*msg), strlen (msg), pipeWriteFd);
+	}
+}
+
+/* eventcmd coprocess (event_command_daemon mode); only touched by the main
+ * thread */
+static pid_t eventCmdPid = -1;
+static FILE *eventCmdPipe = NULL;
+
+/*	close pipe and reap the eventcmd coprocess; the child exits on its own
+ *	when its stdin is closed
+ */
+static void BarUiEventCmdReap (void) {
+	int status;
+
+	if (eventCmdPipe != NULL) {
+		fclose (eventCmdPipe);
+		eventCmdPipe = NULL;
+	}
+	if (eventCmdPid != -1) {
+		waitpid (eventCmdPid, &status, 0);
+		eventCmdPid = -1;
+	}
+}
+
+/*	spawn the eventcmd coprocess; it is execed once with "daemon" as its
+ *	only argument and receives blank-line-terminated event records on stdin
+ *	@param settings containing the cmdline
+ *	@return true if the coprocess is running
+ */
+static bool BarUiEventCmdSpawn (const BarSettings_t *settings) {
+	int pipeFd[2];
+
+	if (pipe (pipeFd) == -1) {
+		BarUiMsg (settings, MSG_ERR, "Cannot create eventcmd pipe. (%s)\n",
+				strerror (errno));
+		return false;
+	}
+
+	eventCmdPid = fork ();
+	if (eventCmdPid == 0) {
+		/* child */
+		close (pipeFd[1]);
+		dup2 (pipeFd[0], fileno (stdin));
+		execl (settings->eventCmd, settings->eventCmd, "daemon",
+				(char *) NULL);
+		BarUiMsg (settings, MSG_ERR, "Cannot start eventcmd. (%s)\n",
+				strerror (errno));
+		close (pipeFd[0]);
+		exit (1);
+	} else if (eventCmdPid == -1) {
+		BarUiMsg (settings, MSG_ERR, "Cannot fork eventcmd. (%s)\n",
+				strerror (errno));
+		close (pipeFd[0]);
+		close (pipeFd[1]);
+		return false;
+	}
+
+	close (pipeFd[0]);
+	/* a dying coprocess must not kill us; the failed write triggers a
+	 * respawn instead */
+	signal (SIGPIPE, SIG_IGN);
+	eventCmdPipe = fdopen (pipeFd[1], "w");
+
+	return true;
+}
+
 /*	Excute external event handler
  *	@param settings containing the cmdline
  *	@param event type
@@ -694,6 +1049,32 @@ void BarUiStartEventCmd (const BarSettings_t *settings, const char *type,
 		return;
 	}
 
+	if (settings->eventCmdDaemon) {
+		/* long-lived coprocess: spawn once and stream records, avoiding a
+		 * fork+exec per event; the event type moves into the record since
+		 * it can't be passed as an argument any more */
+		for (unsigned int attempt = 0; attempt < 2; attempt++) {
+			if (eventCmdPipe == NULL && !BarUiEventCmdSpawn (settings)) {
+				return;
+			}
+
+			fprintf (eventCmdPipe, "event=%s\n", type);
+			BarUiEventCmdPayload (eventCmdPipe, settings, curStation,
+					curSong, player, stations, pRet, wRet);
+			/* a blank line terminates the record */
+			fputc ('\n', eventCmdPipe);
+			if (fflush (eventCmdPipe) == 0) {
+				return;
+			}
+
+			/* coprocess is gone; respawn once and resend this event */
+			BarUiEventCmdReap ();
+		}
+		BarUiMsg (settings, MSG_ERR, "Cannot write to eventcmd. (%s)\n",
+				strerror (errno));
+		return;
+	}
+
 	if (pipe (pipeFd) == -1) {
 		BarUiMsg (settings, MSG_ERR, "Cannot create eventcmd pipe. (%s)\n", strerror (errno));
 		return;
@@ -713,69 +1094,15 @@ void BarUiStartEventCmd (const BarSettings_t *settings, const char *type,
 	} else {
 		/* parent */
 		int status;
-		PianoStation_t *songStation = NULL;
 		FILE *pipeWriteFd;
 
 		close (pipeFd[0]);
 
 		pipeWriteFd = fdopen (pipeFd[1], "w");
 
-		if (curSong != NULL && stations != NULL && curStation->isQuickMix) {
-			songStation = PianoFindStationById (stations, curSong->stationId);
-		}
+		BarUiEventCmdPayload (pipeWriteFd, settings, curStation, curSong,
+				player, stations, pRet, wRet);
 
-		fprintf (pipeWriteFd,
-				"artist=%s\n"
-				"title=%s\n"
-				"album=%s\n"
-				"coverArt=%s\n"
-				"stationName=%s\n"
-				"songStationName=%s\n"
-				"pRet=%i\n"
-				"pRetStr=%s\n"
-				"wRet=%i\n"
-				"wRetStr=%s\n"
-				"songDuration=%u\n"
-				"songPlayed=%u\n"
-				"rating=%i\n"
-				"detailUrl=%s\n",
-				curSong == NULL ? "" : curSong->artist,
-				curSong == NULL ? "" : curSong->title,
-				curSong == NULL ? "" : curSong->album,
-				curSong == NULL ? "" : curSong->coverArt,
-				curStation == NULL ? "" : curStation->name,
-				songStation == NULL ? "" : songStation->name,
-				pRet,
-				PianoErrorToStr (pRet),
-				wRet,
-				WaitressErrorToStr (wRet),
-				player->songDuration,
-				player->songPlayed,
-				curSong == NULL ? PIANO_RATE_NONE : curSong->rating,
-				curSong == NULL ? "" : curSong->detailUrl
-				);
-
-		if (stations != NULL) {
-			/* send station list */
-			PianoStation_t **sortedStations = NULL;
-			size_t stationCount;
-			sortedStations = BarSortedStations (stations, &stationCount,
-					settings->sortOrder);
-			assert (sortedStations != NULL);
-
-			fprintf (pipeWriteFd, "stationCount=%zd\n", stationCount);
-
-			for (size_t i = 0; i < stationCount; i++) {
-				const PianoStation_t *currStation = sortedStations[i];
-				fprintf (pipeWriteFd, "station%zd=%s\n", i,
-						currStation->name);
-			}
-			free (sortedStations);
-		} else {
-			const char * const msg = "stationCount=0\n";
-			fwrite (msg, sizeof (*msg), strlen (msg), pipeWriteFd);
-		}
-	
 		/* closes pipeFd[1] as well */
 		fclose (pipeWriteFd);
 		/* wait to get rid of the zombie */
@@ -783,7 +1110,15 @@ void BarUiStartEventCmd (const BarSettings_t *settings, const char *type,
 	}
 }
 
-/*	prepend song to history
+/*	stop the eventcmd coprocess, if one is running
+ */
+void BarUiStopEventCmd (void) {
+	BarUiEventCmdReap ();
+}
+
+/*	prepend song to history; the history is capped at settings.history
+ *	entries and tracked by a fixed-size ring of slots, so evicting the
+ *	oldest entry is O(1) instead of a list walk
  */
 void BarUiHistoryPrepend (BarApp_t *app, PianoSong_t *song) {
 	assert (app != NULL);
@@ -791,20 +1126,36 @@ void BarUiHistoryPrepend (BarApp_t *app, PianoSong_t *song) {
 	/* make sure it's a single song */
 	assert (PianoListNextP (song) == NULL);
 
-	if (app->settings.history != 0) {
-		app->songHistory = PianoListPrependP (app->songHistory, song);
-		PianoSong_t *del;
-		do {
-			del = PianoListGetP (app->songHistory, app->settings.history);
-			if (del != NULL) {
-				app->songHistory = PianoListDeleteP (app->songHistory, del);
-				PianoDestroyPlaylist (del);
-			} else {
-				break;
-			}
-		} while (true);
-	} else {
+	const unsigned int cap = app->settings.history;
+
+	if (cap == 0) {
 		PianoDestroyPlaylist (song);
+		return;
+	}
+
+	if (app->songHistoryRing == NULL) {
+		app->songHistoryRing = calloc (cap, sizeof (*app->songHistoryRing));
+		app->songHistoryPos = 0;
+		app->songHistoryLen = 0;
 	}
+
+	app->songHistory = PianoListPrependP (app->songHistory, song);
+
+	if (app->songHistoryLen == cap) {
+		/* the slot the new song goes into holds the oldest entry, which is
+		 * the list's tail; its predecessor is in the second-oldest slot */
+		PianoSong_t * const oldest =
+				app->songHistoryRing[app->songHistoryPos];
+		PianoSong_t * const pred = cap >= 2 ?
+				app->songHistoryRing[(app->songHistoryPos + 1) % cap] : song;
+		assert (PianoListNextP (oldest) == NULL);
+		pred->head.next = NULL;
+		PianoDestroyPlaylist (oldest);
+	} else {
+		++app->songHistoryLen;
+	}
+
+	app->songHistoryRing[app->songHistoryPos] = song;
+	app->songHistoryPos = (app->songHistoryPos + 1) % cap;
 }
 
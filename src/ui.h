@@ -40,6 +40,7 @@ typedef void (*BarUiSelectStationCallback_t) (BarApp_t *app, char *buf);
 void BarUiMsg (const BarSettings_t *, const BarUiMsg_t, const char *, ...) __attribute__((format(printf, 3, 4)));
 PianoStation_t *BarUiSelectStation (BarApp_t *, PianoStation_t *, const char *,
 		BarUiSelectStationCallback_t, bool);
+void BarUiDestroyStationIndex (void);
 PianoSong_t *BarUiSelectSong (const BarSettings_t *, PianoSong_t *,
 		BarReadlineFds_t *);
 PianoArtist_t *BarUiSelectArtist (BarApp_t *, PianoArtist_t *);
@@ -51,8 +52,10 @@ size_t BarUiListSongs (const BarSettings_t *, const PianoSong_t *, const char *)
 void BarUiStartEventCmd (const BarSettings_t *, const char *,
 		const PianoStation_t *, const PianoSong_t *, const player_t *,
 		PianoStation_t *, PianoReturn_t, WaitressReturn_t);
+void BarUiStopEventCmd (void);
 int BarUiPianoCall (BarApp_t * const, PianoRequestType_t,
 		void *, PianoReturn_t *, WaitressReturn_t *);
+PianoStation_t *BarUiStations (BarApp_t * const);
 void BarUiHistoryPrepend (BarApp_t *app, PianoSong_t *song);
 
 #endif /* SRC_UI_H_46P20TS0 */
@@ -31,11 +31,12 @@ THE SOFTWARE.
 #include "ui.h"
 #include "ui_readline.h"
 #include "ui_dispatch.h"
+#include "stats.h"
 
 /*	standard eventcmd call
  */
 #define BarUiActDefaultEventcmd(name) BarUiStartEventCmd (&app->settings, \
-		name, selStation, selSong, &app->player, app->ph.stations, \
+		name, selStation, selSong, &app->player, BarUiStations (app), \
 		pRet, wRet)
 
 /*	standard piano call
@@ -129,7 +130,7 @@ BarUiActCallback(BarUiActBanSong) {
 	assert (selSong != NULL);
 	assert (selSong->stationId != NULL);
 
-	if ((realStation = PianoFindStationById (app->ph.stations,
+	if ((realStation = PianoFindStationById (BarUiStations (app),
 			selSong->stationId)) == NULL) {
 		assert (0);
 		return;
@@ -335,7 +336,7 @@ BarUiActCallback(BarUiActSongInfo) {
 	/* print real station if quickmix */
 	BarUiPrintSong (&app->settings, selSong,
 			selStation->isQuickMix ?
-			PianoFindStationById (app->ph.stations, selSong->stationId) :
+			PianoFindStationById (BarUiStations (app), selSong->stationId) :
 			NULL);
 }
 
@@ -383,7 +384,7 @@ BarUiActCallback(BarUiActLoveSong) {
 	assert (selSong != NULL);
 	assert (selSong->stationId != NULL);
 
-	if ((realStation = PianoFindStationById (app->ph.stations,
+	if ((realStation = PianoFindStationById (BarUiStations (app),
 			selSong->stationId)) == NULL) {
 		assert (0);
 		return;
@@ -462,7 +463,7 @@ BarUiActCallback(BarUiActRenameStation) {
 /*	play another station
  */
 BarUiActCallback(BarUiActSelectStation) {
-	PianoStation_t *newStation = BarUiSelectStation (app, app->ph.stations,
+	PianoStation_t *newStation = BarUiSelectStation (app, BarUiStations (app),
 			"Select station: ", NULL, app->settings.autoselect);
 	if (newStation != NULL) {
 		app->curStation = newStation;
@@ -510,7 +511,7 @@ BarUiActCallback(BarUiActPrintUpcoming) {
  *	all/none
  */
 static void BarUiActQuickmixCallback (BarApp_t *app, char *buf) {
-	PianoStation_t *curStation = app->ph.stations;
+	PianoStation_t *curStation = BarUiStations (app);
 
 	/* do nothing if buf is empty/contains more than one character */
 	if (buf[0] == '\0' || buf[1] != '\0') {
@@ -555,7 +556,7 @@ BarUiActCallback(BarUiActSelectQuickMix) {
 
 	if (selStation->isQuickMix) {
 		PianoStation_t *toggleStation;
-		while ((toggleStation = BarUiSelectStation (app, app->ph.stations,
+		while ((toggleStation = BarUiSelectStation (app, BarUiStations (app),
 				"Toggle quickmix for station: ",
 				BarUiActQuickmixCallback, false)) != NULL) {
 			toggleStation->useQuickMix = !toggleStation->useQuickMix;
@@ -586,7 +587,7 @@ BarUiActCallback(BarUiActHistory) {
 				&app->input);
 		if (histSong != NULL) {
 			BarKeyShortcutId_t action;
-			PianoStation_t *songStation = PianoFindStationById (app->ph.stations,
+			PianoStation_t *songStation = PianoFindStationById (BarUiStations (app),
 					histSong->stationId);
 
 			if (songStation == NULL) {
@@ -658,6 +659,12 @@ BarUiActCallback(BarUiActVolReset) {
 	BarPlayerSetVolume (&app->player);
 }
 
+/*	print performance statistics
+ */
+BarUiActCallback(BarUiActStats) {
+	BarStatsDump (&app->settings);
+}
+
 /*	manage station (remove seeds or feedback)
  */
 BarUiActCallback(BarUiActManageStation) {
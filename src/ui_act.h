@@ -61,5 +61,6 @@ BarUiActCallback(BarUiActVolDown);
 BarUiActCallback(BarUiActVolUp);
 BarUiActCallback(BarUiActManageStation);
 BarUiActCallback(BarUiActVolReset);
+BarUiActCallback(BarUiActStats);
 
 #endif /* SRC_UI_ACT_H_1FEFTC06 */
@@ -45,7 +45,11 @@ BarKeyShortcutId_t BarUiDispatch (BarApp_t *app, const char key, PianoStation_t
 		context |= BAR_DC_SONG;
 	}
 
-	for (size_t i = 0; i < BAR_KS_COUNT; i++) {
+	/* the key map points at the first action bound to this key (usually a
+	 * direct hit); the scan only continues past it if that action's context
+	 * does not apply and another action shares the key */
+	for (size_t i = app->settings.keyMap[(unsigned char) key];
+			i < BAR_KS_COUNT; i++) {
 		if (app->settings.keys[i] != BAR_KS_DISABLED &&
 				app->settings.keys[i] == key) {
 			if ((dispatchActions[i].context & context) == dispatchActions[i].context) {
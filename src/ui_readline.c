@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
 #include <assert.h>
 
 #include "ui_readline.h"
@@ -55,7 +56,6 @@ size_t BarReadline (char *buf, const size_t bufSize, const char *mask,
 		BarReadlineFds_t *input, const BarReadlineFlags_t flags, int timeout) {
 	size_t bufLen = 0;
 	unsigned char escapeState = 0;
-	fd_set set;
 	const bool echo = !(flags & BAR_RL_NOECHO);
 
 	assert (buf != NULL);
@@ -69,32 +69,46 @@ size_t BarReadline (char *buf, const size_t bufSize, const char *mask,
 	while (1) {
 		int curFd = -1;
 		unsigned char chr;
-		struct timeval timeoutstruct;
+		struct pollfd fdset[3];
 
-		/* select modifies set and timeout */
-		memcpy (&set, &input->set, sizeof (set));
-		timeoutstruct.tv_sec = timeout;
-		timeoutstruct.tv_usec = 0;
-
-		if (select (input->maxfd, &set, NULL, NULL,
-				(timeout == -1) ? NULL : &timeoutstruct) <= 0) {
+		assert (sizeof (input->fds) / sizeof (*input->fds) == 2);
+		/* negative fds are ignored by poll() */
+		fdset[0].fd = input->fds[0];
+		fdset[0].events = POLLIN;
+		fdset[0].revents = 0;
+		fdset[1].fd = input->fds[1];
+		fdset[1].events = POLLIN;
+		fdset[1].revents = 0;
+		fdset[2].fd = (flags & BAR_RL_EVENTS) ? input->eventfd : -1;
+		fdset[2].events = POLLIN;
+		fdset[2].revents = 0;
+
+		if (poll (fdset, sizeof (fdset) / sizeof (*fdset),
+				(timeout == -1) ? -1 : timeout * 1000) <= 0) {
 			/* fail or timeout */
 			break;
 		}
 
-		assert (sizeof (input->fds) / sizeof (*input->fds) == 2);
-		if (FD_ISSET(input->fds[0], &set)) {
+		if (fdset[2].revents != 0) {
+			/* worker thread event; drain the pipe and return to the caller,
+			 * which re-evaluates its state */
+			char drain[16];
+			read (input->eventfd, drain, sizeof (drain));
+			break;
+		}
+
+		if (fdset[0].revents != 0) {
 			curFd = input->fds[0];
-		} else if (input->fds[1] != -1 && FD_ISSET(input->fds[1], &set)) {
+		} else if (fdset[1].revents != 0) {
 			curFd = input->fds[1];
 		}
-		if (read (curFd, &chr, sizeof (chr)) <= 0) {
-			/* select() is going wild if fdset contains EOFed stdin, only check
+		if (curFd == -1 || read (curFd, &chr, sizeof (chr)) <= 0) {
+			/* poll() is going wild if fdset contains EOFed stdin, only check
 			 * for stdin, fifo is "reopened" as soon as another writer is
 			 * available
 			 * FIXME: ugly */
 			if (curFd == STDIN_FILENO) {
-				FD_CLR (curFd, &input->set);
+				input->fds[0] = -1;
 			}
 			continue;
 		}
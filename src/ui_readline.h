@@ -25,18 +25,20 @@ THE SOFTWARE.
 #define SRC_UI_READLINE_H_IFRX74VM
 
 #include <stdbool.h>
-#include <sys/select.h>
 
 typedef enum {
 	BAR_RL_DEFAULT = 0,
 	BAR_RL_FULLRETURN = 1, /* return if buffer is full */
 	BAR_RL_NOECHO = 2, /* don't echo to stdout */
+	BAR_RL_EVENTS = 4, /* also wake up and return on eventfd activity */
 } BarReadlineFlags_t;
 
 typedef struct {
-	fd_set set;
-	int maxfd;
+	/* stdin and control fifo; -1 entries are ignored */
 	int fds[2];
+	/* read end of the worker event pipe or -1, only watched with
+	 * BAR_RL_EVENTS */
+	int eventfd;
 } BarReadlineFds_t;
 
 size_t BarReadline (char *, const size_t, const char *,